@@ -4,6 +4,10 @@
 #include <cstdint>
 #include <dsa/Vec2.hpp>
 
+// a single particle record. the Simulator keeps particles in a ParticleStore;
+// this is what gets handed to it when spawning. ids are handed out by the
+// Simulator that stores the particle, so separate simulators (and repeated
+// runs) number their particles identically
 struct Particle {
  public:
   Vec2f position;
@@ -13,7 +17,7 @@ struct Particle {
   float radius;
   float mass;
   float invMass;
-  uint32_t id;
+  uint32_t id = 0;
 
   Particle(Vec2f pos, Vec2f vel, float dt = 1.0f / 60.0f, float r = 10.0f,
            float m = 1.0f)
@@ -21,36 +25,13 @@ struct Particle {
         prevPosition(pos - vel * dt),
         velocity(vel),
         radius(r),
-        mass(m),
-        id(nextId()) {
+        mass(m) {
     if (mass == 0.0f) {
       invMass = 0.0f;
     } else {
       invMass = 1.0f / mass;
     }
   };
-
-  void integrateEuler(float dt) noexcept {
-    velocity += acceleration * dt;
-    position += velocity * dt;
-    acceleration = {0.0f, 0.0f};
-  }
-
-  void integrateVerlet(float dt) noexcept {
-    Vec2f newPos =
-        position + (position - prevPosition) + acceleration * dt * dt;
-    prevPosition = position;
-    position = newPos;
-    acceleration = {0.0f, 0.0f};
-  }
-
-  void accelerate(Vec2f accel) noexcept { acceleration += accel; };
-
- private:
-  static uint32_t nextId() noexcept {
-    static uint32_t counter = 0;
-    return counter++;
-  }
 };
 
 #endif
@@ -0,0 +1,187 @@
+#ifndef PARTICLESTORE_H
+#define PARTICLESTORE_H
+
+#include <Particle.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <dsa/Vec2.hpp>
+#include <vector>
+
+// read-only view over particle arrays. this is what the renderer and the
+// broad-phases iterate, so they never depend on how particles are stored
+struct ParticleView {
+  const float* x = nullptr;
+  const float* y = nullptr;
+  // where each particle was when the last update() started. renderers lerp
+  // from here towards x/y to draw between fixed steps
+  const float* lastX = nullptr;
+  const float* lastY = nullptr;
+  const float* radius = nullptr;
+  const uint32_t* id = nullptr;
+  size_t count = 0;
+
+  size_t size() const noexcept { return count; }
+  bool empty() const noexcept { return count == 0; }
+  Vec2f position(size_t i) const noexcept { return {x[i], y[i]}; }
+  Vec2f lastPosition(size_t i) const noexcept { return {lastX[i], lastY[i]}; }
+};
+
+// structure-of-arrays particle storage. each hot loop only streams the
+// arrays it actually touches instead of whole Particle records
+struct ParticleStore {
+  std::vector<float> x, y;
+  std::vector<float> prevX, prevY;
+  std::vector<float> lastX, lastY;  // position at the start of the last step
+  std::vector<float> vx, vy;
+  std::vector<float> ax, ay;
+  std::vector<float> radius;
+  std::vector<float> mass, invMass;
+  std::vector<uint32_t> id;
+  // consecutive steps spent nearly still. the simulator puts a particle to
+  // sleep once this reaches its threshold and zeroes it to wake it
+  std::vector<uint32_t> rest;
+
+  size_t size() const noexcept { return x.size(); }
+  bool empty() const noexcept { return x.empty(); }
+
+  void reserve(size_t n) {
+    x.reserve(n);
+    y.reserve(n);
+    prevX.reserve(n);
+    prevY.reserve(n);
+    lastX.reserve(n);
+    lastY.reserve(n);
+    vx.reserve(n);
+    vy.reserve(n);
+    ax.reserve(n);
+    ay.reserve(n);
+    radius.reserve(n);
+    mass.reserve(n);
+    invMass.reserve(n);
+    id.reserve(n);
+    rest.reserve(n);
+  }
+
+  void clear() noexcept {
+    x.clear();
+    y.clear();
+    prevX.clear();
+    prevY.clear();
+    lastX.clear();
+    lastY.clear();
+    vx.clear();
+    vy.clear();
+    ax.clear();
+    ay.clear();
+    radius.clear();
+    mass.clear();
+    invMass.clear();
+    id.clear();
+    rest.clear();
+  }
+
+  void push(const Particle& p) {
+    x.push_back(p.position.x);
+    y.push_back(p.position.y);
+    prevX.push_back(p.prevPosition.x);
+    prevY.push_back(p.prevPosition.y);
+    lastX.push_back(p.position.x);
+    lastY.push_back(p.position.y);
+    vx.push_back(p.velocity.x);
+    vy.push_back(p.velocity.y);
+    ax.push_back(p.acceleration.x);
+    ay.push_back(p.acceleration.y);
+    radius.push_back(p.radius);
+    mass.push_back(p.mass);
+    invMass.push_back(p.invMass);
+    id.push_back(p.id);
+    rest.push_back(0);
+  }
+
+  // appends n zeroed slots to every array, for bulk spawning to fill in
+  void grow(size_t n) {
+    forEachArray([n](const char*, auto& v) { v.resize(v.size() + n); });
+  }
+
+  Vec2f position(size_t i) const noexcept { return {x[i], y[i]}; }
+
+  void accelerate(size_t i, Vec2f accel) noexcept {
+    ax[i] += accel.x;
+    ay[i] += accel.y;
+  }
+
+  // reorders every array so that new[k] = old[order[k]]. ids travel with
+  // their particles, so anything keyed by id is unaffected
+  void permute(const std::vector<uint32_t>& order) {
+    gather(x, order);
+    gather(y, order);
+    gather(prevX, order);
+    gather(prevY, order);
+    gather(lastX, order);
+    gather(lastY, order);
+    gather(vx, order);
+    gather(vy, order);
+    gather(ax, order);
+    gather(ay, order);
+    gather(radius, order);
+    gather(mass, order);
+    gather(invMass, order);
+    gather(id, order);
+    gather(rest, order);
+  }
+
+  // calls fn(tag, array) for every per-particle array. tags are four
+  // characters and stable, so serialisers can key on them
+  template <typename Fn>
+  void forEachArray(Fn&& fn) {
+    forEachArrayOf(*this, fn);
+  }
+  template <typename Fn>
+  void forEachArray(Fn&& fn) const {
+    forEachArrayOf(*this, fn);
+  }
+
+  ParticleView view() const noexcept {
+    return {x.data(),      y.data(),  lastX.data(), lastY.data(),
+            radius.data(), id.data(), x.size()};
+  }
+
+ private:
+  std::vector<float> scratchF_;
+
+  template <typename Store, typename Fn>
+  static void forEachArrayOf(Store& s, Fn& fn) {
+    fn("X   ", s.x);
+    fn("Y   ", s.y);
+    fn("PX  ", s.prevX);
+    fn("PY  ", s.prevY);
+    fn("LX  ", s.lastX);
+    fn("LY  ", s.lastY);
+    fn("VX  ", s.vx);
+    fn("VY  ", s.vy);
+    fn("AX  ", s.ax);
+    fn("AY  ", s.ay);
+    fn("R   ", s.radius);
+    fn("M   ", s.mass);
+    fn("IM  ", s.invMass);
+    fn("ID  ", s.id);
+    fn("RS  ", s.rest);
+  }
+  std::vector<uint32_t> scratchU_;
+
+  void gather(std::vector<float>& v, const std::vector<uint32_t>& order) {
+    scratchF_.reserve(v.capacity());
+    scratchF_.resize(v.size());
+    for (size_t k = 0; k < order.size(); k++) scratchF_[k] = v[order[k]];
+    v.swap(scratchF_);
+  }
+
+  void gather(std::vector<uint32_t>& v, const std::vector<uint32_t>& order) {
+    scratchU_.reserve(v.capacity());
+    scratchU_.resize(v.size());
+    for (size_t k = 0; k < order.size(); k++) scratchU_[k] = v[order[k]];
+    v.swap(scratchU_);
+  }
+};
+
+#endif
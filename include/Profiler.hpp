@@ -0,0 +1,81 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// scoped wall-clock timers for finding where a frame goes.
+//
+// RPE_PROFILE_SCOPE("name") times the rest of the enclosing block. it only
+// does anything when built with RPENGINE_PROFILE (cmake -DRPENGINE_PROFILE=ON)
+// and compiles to nothing otherwise. names must be string literals.
+//
+// every thread appends finished scopes to its own ring buffer of the last
+// RING_EVENTS events without taking a lock, so timing never contends across
+// threads, not even with a summary or trace being read out. the rings can be
+// summarised per frame (the Renderer's overlay) or dumped as Chrome
+// trace-event JSON for chrome://tracing or Perfetto
+class Profiler {
+ public:
+#ifdef RPENGINE_PROFILE
+  static constexpr bool ENABLED = true;
+#else
+  static constexpr bool ENABLED = false;
+#endif
+  static constexpr size_t RING_EVENTS = 1 << 14;
+  static constexpr uint32_t MAX_DEPTH = 32;
+
+  struct Event {
+    const char* name;
+    uint64_t start, end;  // ns since the profiler started
+    uint32_t depth;       // nesting level on its thread
+  };
+
+  struct PhaseTotal {
+    const char* name;
+    double seconds;  // time in the scope minus time in scopes nested in it
+  };
+
+  class Scope {
+   public:
+    explicit Scope(const char* name) noexcept;
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    const char* name_;
+    uint64_t start_;
+  };
+
+  static uint64_t now() noexcept;
+
+  // labels the calling thread in traces. threads that don't summarise (pool
+  // workers, whose time already shows up in the scope that dispatched them)
+  // are left out of frameSummary
+  static void setThreadName(const char* name, bool summarize = true);
+
+  // closes the current frame for frameSummary. call once per frame
+  static void markFrame() noexcept;
+
+  // self time per scope name over the last frame closed by markFrame,
+  // largest first
+  static void frameSummary(std::vector<PhaseTotal>& out);
+
+  // throws std::runtime_error if path can't be written
+  static void writeChromeTrace(const std::string& path);
+};
+
+#ifdef RPENGINE_PROFILE
+#define RPE_PROFILE_CONCAT_(a, b) a##b
+#define RPE_PROFILE_CONCAT(a, b) RPE_PROFILE_CONCAT_(a, b)
+#define RPE_PROFILE_SCOPE(name) \
+  const Profiler::Scope RPE_PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#else
+#define RPE_PROFILE_SCOPE(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <ParticleStore.hpp>
+#include <Simulator.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <dsa/TripleBuffer.hpp>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// immutable copy of the particle arrays after one step. the renderer draws
+// from this instead of the live Simulator, so it never waits on physics
+struct RenderSnapshot {
+  std::vector<float> x, y, lastX, lastY, radius;
+  std::vector<uint32_t> id;
+  uint64_t step = 0;
+  float dt = 0.0f;
+  std::chrono::steady_clock::time_point publishedAt;
+
+  // how far the simulation has moved on since this step, in steps. drawing
+  // lastX..x at this fraction trails the simulation by exactly one step
+  float interpolationAlpha() const noexcept {
+    const float since = std::chrono::duration<float>(
+                            std::chrono::steady_clock::now() - publishedAt)
+                            .count();
+    return dt > 0.0f ? std::min(since / dt, 1.0f) : 1.0f;
+  }
+
+  ParticleView view() const noexcept {
+    return {x.data(),      y.data(),  lastX.data(), lastY.data(),
+            radius.data(), id.data(), x.size()};
+  }
+};
+
+// runs Simulator::update() on its own thread at the simulator's fixed dt and
+// publishes a RenderSnapshot after every step through a triple buffer.
+//
+// while the thread runs, nothing else may touch the Simulator directly:
+// changes go through post() and are applied between steps, in order
+class SimulationThread {
+ public:
+  using Command = std::function<void(Simulator&)>;
+
+  explicit SimulationThread(Simulator& sim);
+  ~SimulationThread();
+
+  SimulationThread(const SimulationThread&) = delete;
+  SimulationThread& operator=(const SimulationThread&) = delete;
+
+  void start();
+  void stop();
+  bool running() const noexcept { return running_.load(); }
+
+  // queue a change for the simulation thread
+  void post(Command cmd);
+
+  // newest published snapshot. stays valid and unchanged until the next call
+  const RenderSnapshot& latest() noexcept {
+    snapshots_.acquire();
+    return snapshots_.front();
+  }
+
+  uint64_t steps() const noexcept { return steps_.load(); }
+
+ private:
+  // steps this far behind are dropped instead of being caught up on
+  static constexpr int MAX_STEP_LAG = 4;
+
+  Simulator& sim_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint64_t> steps_{0};
+
+  std::mutex commandMutex_;
+  std::vector<Command> pending_;
+  std::vector<Command> executing_;
+
+  TripleBuffer<RenderSnapshot> snapshots_;
+
+  void loop();
+  void applyCommands();
+  void publishSnapshot();
+};
+
+#endif
@@ -2,35 +2,173 @@
 #define SIMULATOR_H
 
 #include <Particle.hpp>
+#include <ParticleStore.hpp>
+#include <ThreadPool.hpp>
+#include <algorithm>
+#include <dsa/HierarchicalGrid.hpp>
 #include <dsa/QuadTree.hpp>
 #include <dsa/SpatialGrid.hpp>
+#include <dsa/SweepAndPrune.hpp>
 #include <dsa/Vec2.hpp>
+#include <memory>
 #include <random>
 #include <vector>
 
+class TrajectoryRecorder;
+
 enum class IntegrationType { Euler, Verlet };
-enum class BroadphaseType { Naive, Qtree, UniformGrid };
+enum class BroadphaseType {
+  Naive,
+  Qtree,
+  UniformGrid,
+  SweepAndPrune,
+  HierarchicalGrid,  // per-radius grid levels, for mixed particle sizes
+};
+
+// wall-clock seconds spent in each phase of the most recent update(), summed
+// over its sub-steps
+struct PhaseTimings {
+  double integrate = 0.0;
+  double build = 0.0;  // SpatialGrid::build / quadtree / SAP sort
+  double narrowphase = 0.0;
+  double reorder = 0.0;  // Z-order re-sort, only on frames that do one
+  double emit = 0.0;     // emitters spawning this step's particles
+};
+
+// how well the broad-phase pruned during the most recent update(). pair
+// counts are summed over its sub-steps; occupancy describes the last one
+struct BroadphaseStats {
+  uint64_t candidatePairs = 0;  // pairs handed to the narrow-phase
+  uint64_t contacts = 0;        // of those, pairs that actually overlapped
+  // particles per grid cell (uniform or hierarchical) or quadtree leaf,
+  // over the non-empty ones. 0 for sweep-and-prune and naive
+  size_t maxPerCell = 0;
+  double meanPerCell = 0.0;
+  int treeDepth = 0;  // quadtree depth, or hierarchical grid levels in use
+  float cellSize = 0.0f;  // uniform grid only
+};
+
+// particles for Simulator::spawnParticles, as parallel arrays of count
+// entries. only x and y are required
+struct SpawnArrays {
+  const float* x = nullptr;
+  const float* y = nullptr;
+  const float* vx = nullptr;  // null: spawn at rest
+  const float* vy = nullptr;
+  const float* radius = nullptr;  // null: every particle gets the same r
+  size_t count = 0;
+};
+
+// generated layouts for Simulator::spawnParticles. Lattice (row by row) and
+// Random place centres in the box at min, HexDisk packs them hexagonally into
+// the disk around center. spacing is the distance between neighbouring
+// centres, 0 for touching particles
+struct SpawnPattern {
+  enum class Shape { Lattice, Random, HexDisk };
+  Shape shape = Shape::Random;
+  Vec2f min, size;
+  Vec2f center;
+  float diskRadius = 0.0f;
+  float spacing = 0.0f;
+  Vec2f velocity;  // shared by every particle
+  float jitter = 0.0f;  // plus a random [-jitter, jitter] on each axis
+};
+
+// a particle source the simulator runs itself. rate is in particles per
+// simulated second, so emission keeps pace with the physics whatever the
+// frame rate. particles leave at speed towards angle (radians, +y is down)
+struct Emitter {
+  enum class Shape {
+    Point,   // from position
+    Line,    // from random points between position and end
+    Stream,  // from position, angle swinging by +-sweep at omega rad/s
+    Area,    // from random points in the box at position of the given size
+  };
+  Shape shape = Shape::Point;
+  Vec2f position;
+  Vec2f end;
+  Vec2f size;
+  float rate = 1000.0f;
+  float speed = 0.0f;
+  float angle = 0.0f;
+  float sweep = 0.0f;
+  float omega = 0.0f;
+  float jitter = 0.0f;  // random [-jitter, jitter] added to each velocity axis
+  float radius = 2.0f;
+  float mass = 1.0f;
+};
 
 class Simulator {
+  friend class Snapshot;
+
  public:
   float gravity;
   float restitution;
 
   Simulator(Vec2f dims, float maxParticleRadius, float g, float C_r, float dt,
             IntegrationType integrationType, BroadphaseType broadphaseType,
-            size_t maxParticles = 100000);
+            size_t maxParticles = 100000, size_t threads = 1);
 
   void configure(Vec2f size, float dt = 1.0f / 60.0f);
-  void setWorldSize(Vec2f size) noexcept { worldSize_ = size; }
+  void setWorldSize(Vec2f size) noexcept;
   Vec2f worldSize() const noexcept { return worldSize_; }
   void setDeltaTime(float dt) noexcept { dt_ = dt; }
+  float deltaTime() const noexcept { return dt_; }
+
+  // fixed-step driving. update() advances exactly one step of deltaTime(),
+  // split into substeps() equal integrate + collide passes. advance() feeds
+  // wall-clock time into an accumulator and runs as many whole steps as it
+  // covers, at most maxCatchUpSteps() worth; the leftover fraction of a step
+  // is interpolationAlpha()
+  void setStepRate(float hz) noexcept { dt_ = 1.0f / hz; }
+  float stepRate() const noexcept { return 1.0f / dt_; }
+  void setSubsteps(size_t n) noexcept { substeps_ = std::max<size_t>(n, 1); }
+  size_t substeps() const noexcept { return substeps_; }
+  void setMaxCatchUpSteps(size_t n) noexcept {
+    maxCatchUpSteps_ = std::max<size_t>(n, 1);
+  }
+  size_t maxCatchUpSteps() const noexcept { return maxCatchUpSteps_; }
+  size_t advance(double elapsedSeconds) noexcept;
+  float interpolationAlpha() const noexcept {
+    return static_cast<float>(accumulator_ / dt_);
+  }
+  // runs are bit-identical for the same seed, inputs and SIMD level, at
+  // any thread count. without a seed() call the generator starts from
+  // std::random_device
+  void seed(uint32_t s) noexcept { gen_.seed(s); }
   float maxParticleRadius() const noexcept { return maxParticleRadius_; }
 
   void spawnParticle(Vec2f pos, Vec2f vel, float r = 10.0f,
                      float m = 1.0f) noexcept;
+  // bulk spawning: every array is filled for the whole batch in one parallel
+  // pass instead of one push per particle. the batch is cut short at
+  // capacity(), or where a lattice or disk runs out of room; returns how
+  // many were added. unlike spawnParticle, a zero velocity stays zero.
+  // Random draws one seed from the generator and hashes it with each
+  // particle's index, so the layout doesn't depend on the thread count
+  size_t spawnParticles(const SpawnArrays& batch, float r = 10.0f,
+                        float m = 1.0f);
+  size_t spawnParticles(const SpawnPattern& pattern, size_t count,
+                        float r = 10.0f, float m = 1.0f);
+
+  // emitters run at the start of every update() and spawn through
+  // spawnParticles. addEmitter returns an id for removeEmitter. snapshots
+  // don't store emitters
+  uint32_t addEmitter(const Emitter& emitter);
+  void removeEmitter(uint32_t id) noexcept;
+  void clearEmitters() noexcept { emitters_.clear(); }
+  size_t emitterCount() const noexcept { return emitters_.size(); }
   void update() noexcept;
-  const std::vector<Particle>& particles() const noexcept { return particles_; }
+  // whole steps run since construction
+  uint64_t steps() const noexcept { return steps_; }
+  ParticleView particles() const noexcept { return particles_.view(); }
+
+  // FNV-1a over every particle array, for checking that two runs (e.g. at
+  // different thread counts) computed exactly the same state
+  uint64_t frameHash() const noexcept;
   size_t capacity() const noexcept { return capacity_; }
+  const PhaseTimings& timings() const noexcept { return timings_; }
+  const BroadphaseStats& broadphaseStats() const noexcept { return stats_; }
   void setIntegrationType(IntegrationType integrationType) noexcept {
     integrationType_ = integrationType;
   }
@@ -38,31 +176,172 @@ class Simulator {
     broadphaseType_ = broadphaseType;
   }
 
+  void setGridLayout(GridLayout layout) noexcept {
+    spatialGrid_.layout = layout;
+    gridCurrent_ = false;
+  }
+  GridLayout gridLayout() const noexcept { return spatialGrid_.layout; }
+
+  // lets the uniform grid re-pick its cell size every few steps from how many
+  // cells it walked and how many pairs it tested for nothing. off, cells stay
+  // 2 * maxParticleRadius(), the smallest the 3x3 neighbour search allows
+  void setAdaptiveGrid(bool on);
+  bool adaptiveGrid() const noexcept { return adaptiveGrid_; }
+  float gridCellSize() const noexcept { return spatialGrid_.cellSize; }
+
+  // particles that rest on the floor (the wall gravity pulls towards), or on
+  // particles that do, and barely move for SLEEP_STEPS steps in a row fall
+  // asleep; floating clumps never do. sleepers stop integrating and
+  // contacts between two of them are skipped, so a settled pile costs little
+  // more than its moving surface. a sleeper wakes when a moving particle
+  // hits it (slower ones lean on it as if it were fixed), under radialPush,
+  // or when gravity or the world changes. without gravity any wall or
+  // contact counts as resting
+  void setSleeping(bool on);
+  bool sleeping() const noexcept { return sleeping_; }
+  size_t sleepingCount() const noexcept { return asleep_; }
+
+  // physically re-sort particles along a Z-order curve of their grid cells
+  // every `frames` steps (0 disables), or sooner once spawning has appended
+  // enough unsorted particles. ids move with their particles
+  void setReorderInterval(size_t frames) noexcept { reorderInterval_ = frames; }
+  size_t reorderInterval() const noexcept { return reorderInterval_; }
+
+  // worker threads shared by every per-particle phase (1 = serial)
+  void setThreadCount(size_t threads);
+  size_t threadCount() const noexcept { return pool_->size(); }
+
+  // hands every finished step to recorder (not owned; nullptr stops). the
+  // recorder must outlive the simulator or be detached first
+  void setRecorder(TrajectoryRecorder* recorder) noexcept {
+    recorder_ = recorder;
+  }
+  TrajectoryRecorder* recorder() const noexcept { return recorder_; }
+
   void radialPush(const Vec2f& origin, const float radius,
                   const float mag = 1000.0f, const int scale = 1);
   // void radialPush(const Vec2f& origin, const float radius = 100.0f,
   //                 const float mag = 1000.0f);
 
  private:
+  // particles handed to a worker per parallelFor chunk
+  static constexpr size_t PARTICLE_GRAIN = 4096;
+  // horizontal bands the grid solve is cut into. fixed rather than derived
+  // from the thread count so the contact order never depends on it
+  static constexpr int SOLVE_BANDS = 64;
+  // adaptive grid: grid solves per decision, the largest cell as a multiple
+  // of the smallest, the relative cost of walking a cell and of testing a
+  // pair, and how much cheaper a new cell size must look to be adopted
+  static constexpr size_t GRID_TUNE_SOLVES = 30;
+  static constexpr float GRID_MAX_CELL_FACTOR = 16.0f;
+  static constexpr double GRID_CELL_COST = 1.0;
+  static constexpr double GRID_PAIR_COST = 4.0;
+  static constexpr double GRID_RETUNE_GAIN = 0.8;
+  // sleeping: steps a particle must stay under SLEEP_SPEED before it sleeps,
+  // and how far a partner must have moved this step to wake it, both speeds
+  // in radii per step
+  static constexpr uint32_t SLEEP_STEPS = 30;
+  static constexpr float SLEEP_SPEED = 0.3f;
+  static constexpr float WAKE_SPEED = 0.6f;
+  // the grid solve skips all-asleep cells once 1 / SLEEP_SKIP_SHARE sleeps
+  static constexpr size_t SLEEP_SKIP_SHARE = 4;
+
   std::mt19937 gen_;
   Vec2f worldSize_;
   float maxParticleRadius_;
-  std::vector<Particle> particles_;
+  ParticleStore particles_;
   float dt_;
+  size_t substeps_ = 1;
+  size_t maxCatchUpSteps_ = 4;
+  double accumulator_ = 0.0;
+  uint64_t steps_ = 0;
+  TrajectoryRecorder* recorder_ = nullptr;
   IntegrationType integrationType_;
   BroadphaseType broadphaseType_;
 
   SpatialGrid spatialGrid_;
+  // false until spatialGrid_ is rebuilt after anything that invalidates it
+  // (reorder, spawn, restore, resize, or a step under another broad-phase).
+  // radialPush rebuilds it on demand
+  bool gridCurrent_ = false;
+  bool adaptiveGrid_ = false;
+  float gridCellFactor_ = 1.0f;  // cell size over 2 * maxParticleRadius_
+  size_t gridTuneSolves_ = 0;
+  uint64_t gridTuneCells_ = 0;   // cells walked since the last decision
+  uint64_t gridTuneMisses_ = 0;  // pairs tested that didn't overlap
+  QuadTree qtree_;
+  std::vector<uint32_t> qtreeNeighbors_;
+  SweepAndPrune sap_;
+  HierarchicalGrid hierGrid_;
   size_t capacity_;
+  uint32_t nextId_ = 0;
+  PhaseTimings timings_;
+  BroadphaseStats stats_;
+  // per-band counters of the grid solve, summed once the bands are done
+  struct BandStats {
+    uint64_t candidatePairs, contacts;
+    size_t occupiedCells, maxPerCell;
+  };
+  std::vector<BandStats> bandStats_;
+  bool sleeping_ = false;
+  size_t asleep_ = 0;
+  float sleepGravity_ = 0.0f;      // gravity the sleepers settled under
+  std::vector<uint8_t> cellAwake_;  // per grid cell, during the solve
+  std::vector<uint8_t> supported_;  // per particle, rested on one this step
+  std::unique_ptr<ThreadPool> pool_;
+
+  // emitters
+  struct EmitterState {
+    Emitter emitter;
+    uint32_t id;
+    double owed;  // fraction of a particle carried over to the next step
+    double time;  // simulated seconds since it was added
+  };
+  std::vector<EmitterState> emitters_;
+  uint32_t nextEmitterId_ = 0;
+  std::vector<float> emitX_, emitY_, emitVx_, emitVy_;  // one batch
+  void runEmitters();
+
+  // spatial reordering
+  size_t reorderInterval_ = 30;
+  size_t framesSinceReorder_ = 0;
+  size_t sizeAtReorder_ = 0;
+  std::vector<uint32_t> sortKeys_, sortOrder_, sortTmpKeys_, sortTmpOrder_;
+  void reorderParticles();
+
+  // resets everything derived from the particle arrays after they were
+  // swapped out wholesale (snapshot restore)
+  void onParticlesReplaced();
+
+  float substepDt() const noexcept { return dt_ / substeps_; }
+  void substep(float dt) noexcept;
+
+  // bulk spawning: appendSlots grows the arrays by up to count (whatever
+  // capacity allows) and returns the first new index; once x, y, v and
+  // radius are in, finishSpawn derives the rest of every slot from first on
+  size_t appendSlots(size_t count);
+  void finishSpawn(size_t first, float m);
 
   // broad-phase
   void naiveBroadphase();
-  void qtreeBroadphase(size_t bucketSize = 4);
+  void qtreeBroadphase(size_t bucketSize = 16);
   void spatialGridBroadphase();
+  void spatialGridSolveBanded();
+  void configureGrid();
+  void tuneGridCellSize();
+  void sweepAndPruneBroadphase();
+  void hierarchicalGridBroadphase();
+
+  // sleeping
+  bool asleep(size_t i) const noexcept {
+    return particles_.rest[i] >= SLEEP_STEPS;
+  }
+  void updateSleep();
+  void wakeAll() noexcept;
 
-  // collisions
-  void applyWall(Particle& p, float w, float h);
-  void particleCollision(Particle& p1, Particle& p2);
+  // collisions. returns whether the pair overlapped
+  bool particleCollision(size_t i, size_t j);
+  void wallCollision(size_t i) noexcept;
   void resolveCollisions();
 };
 
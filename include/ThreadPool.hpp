@@ -0,0 +1,90 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// persistent work-stealing pool. threads are created once and sleep between
+// jobs; the calling thread always participates as worker 0, so a pool of size
+// 1 spawns no threads and runs everything inline.
+//
+// parallelFor splits [begin, end) into grain-sized chunks and deals them out
+// as contiguous runs, one per worker queue. a worker drains its own queue from
+// the front and steals from the back of the others once it runs dry
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // number of threads that execute tasks, including the caller
+  size_t size() const noexcept { return queues_.size(); }
+
+  // calls fn(chunkBegin, chunkEnd) over [begin, end) and blocks until done
+  template <typename Fn>
+  void parallelFor(size_t begin, size_t end, size_t grain, Fn&& fn) {
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+    if (workers_.empty() || end - begin <= grain) {
+      fn(begin, end);
+      return;
+    }
+    using F = std::remove_reference_t<Fn>;
+    dispatch(begin, end, grain,
+             const_cast<void*>(static_cast<const void*>(&fn)),
+             [](void* ctx, size_t b, size_t e) { (*static_cast<F*>(ctx))(b, e); });
+  }
+
+  // calls fn(task) for every task in [0, tasks), one task per chunk
+  template <typename Fn>
+  void run(size_t tasks, Fn&& fn) {
+    parallelFor(0, tasks, 1, [&](size_t b, size_t e) {
+      for (size_t t = b; t < e; t++) fn(t);
+    });
+  }
+
+ private:
+  struct Range {
+    size_t begin, end;
+  };
+
+  // chunks owned by one worker; the owner pops the front, thieves the back
+  struct alignas(64) Queue {
+    std::mutex mutex;
+    std::vector<Range> items;
+    size_t head = 0;
+    size_t tail = 0;
+  };
+
+  using Thunk = void (*)(void*, size_t, size_t);
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+
+  void* jobCtx_ = nullptr;
+  Thunk jobFn_ = nullptr;
+  size_t busyWorkers_ = 0;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+
+  void dispatch(size_t begin, size_t end, size_t grain, void* ctx, Thunk fn);
+  void workerLoop(size_t self);
+  void drain(size_t self);
+  bool popOwn(size_t self, Range& out);
+  bool steal(size_t self, Range& out);
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef HIERARCHICALGRID_H
+#define HIERARCHICALGRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <dsa/Vec2.hpp>
+#include <vector>
+
+// stack of uniform grids whose cell size doubles per level. an item of radius
+// r lives in the finest level whose cells are at least 2r wide, so small
+// particles keep small cells no matter how large the biggest one is.
+//
+// a pair is found by the item on the finer (or equal) level: it scans the 3x3
+// block around its own cell on its level, then the 3x3 block around the cell
+// containing it on every coarser, non-empty level. two items on levels a <= b
+// can only touch if they are less than cellSize(b) apart, so 3x3 is enough.
+// all levels share one counting-sorted index array
+class HierarchicalGrid {
+ public:
+  static constexpr int MAX_LEVELS = 12;
+  // cells on the finest level; no coarser level has more, so all levels
+  // together stay far below INT_MAX
+  static constexpr int64_t MAX_LEVEL_CELLS = int64_t(1) << 22;
+
+  // bins items [0, n). the finest cell size is 2 * the smallest radius
+  // present unless the caps below coarsen it, the number of levels follows
+  // from the largest one
+  void build(const float* xs, const float* ys, const float* radius, size_t n,
+             Vec2f worldSize) {
+    levelCount_ = 0;
+    if (n == 0) return;
+
+    float minR = radius[0], maxR = radius[0];
+    for (size_t i = 1; i < n; i++) {
+      minR = std::min(minR, radius[i]);
+      maxR = std::max(maxR, radius[i]);
+    }
+    // tiny radii in a large world would need billions of cells, and a
+    // radius spread wider than MAX_LEVELS doublings would leave the largest
+    // items in cells narrower than they are; coarser cells only cost extra
+    // pair checks
+    float baseCell = std::max(2.0f * minR, 1e-3f);
+    baseCell = std::max(baseCell, 2.0f * maxR / float(1 << (MAX_LEVELS - 1)));
+    while (axisCells(worldSize.x, baseCell) * axisCells(worldSize.y, baseCell) >
+           MAX_LEVEL_CELLS) {
+      baseCell *= 2.0f;
+    }
+
+    int cells = 0;
+    float cellSize = baseCell;
+    do {
+      Level& lv = levels_[levelCount_];
+      lv.cellSize = cellSize;
+      lv.invCellSize = 1.0f / cellSize;
+      lv.cols = static_cast<int>(axisCells(worldSize.x, cellSize));
+      lv.rows = static_cast<int>(axisCells(worldSize.y, cellSize));
+      lv.offset = cells;
+      lv.count = 0;
+      cells += lv.cols * lv.rows;
+      levelCount_++;
+      cellSize *= 2.0f;
+    } while (levelCount_ < MAX_LEVELS && cellSize * 0.5f < 2.0f * maxR);
+
+    if (cellStart_.size() < static_cast<size_t>(cells) + 1) {
+      cellStart_.resize(static_cast<size_t>(cells) + 1);
+    }
+    std::fill(cellStart_.begin(), cellStart_.begin() + cells + 1, 0);
+    cellOf_.resize(n);
+    levelOf_.resize(n);
+    sorted_.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+      int l = 0;
+      while (l + 1 < levelCount_ && levels_[l].cellSize < 2.0f * radius[i]) l++;
+      const Level& lv = levels_[l];
+      const int c = lv.offset + cellIndex(lv, xs[i], ys[i]);
+      levels_[l].count++;
+      levelOf_[i] = static_cast<uint8_t>(l);
+      cellOf_[i] = c;
+      cellStart_[c]++;
+    }
+
+    // inclusive prefix sum turns counts into cell ends; scattering back to
+    // front walks each end down to the cell's start and keeps indices
+    // ascending within a cell
+    maxCellCount_ = 0;
+    occupiedCells_ = 0;
+    int end = 0;
+    for (int c = 0; c < cells; c++) {
+      const int count = cellStart_[c];
+      if (count > 0) occupiedCells_++;
+      maxCellCount_ = std::max(maxCellCount_, count);
+      end += count;
+      cellStart_[c] = end;
+    }
+    cellStart_[cells] = static_cast<int>(n);
+    for (size_t i = n; i-- > 0;) {
+      sorted_[--cellStart_[cellOf_[i]]] = static_cast<int>(i);
+    }
+  }
+
+  // calls fn(j) for every candidate j of item i that i is responsible for:
+  // items with j > i on its own level and every item on coarser levels
+  template <typename Fn>
+  void queryPairs(size_t i, float x, float y, Fn&& fn) const {
+    const int own = levelOf_[i];
+    for (int l = own; l < levelCount_; l++) {
+      const Level& lv = levels_[l];
+      if (lv.count == 0) continue;
+
+      const int cx = std::clamp(static_cast<int>(x * lv.invCellSize), 0, lv.cols - 1);
+      const int cy = std::clamp(static_cast<int>(y * lv.invCellSize), 0, lv.rows - 1);
+      for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, lv.rows - 1); ny++) {
+        for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, lv.cols - 1); nx++) {
+          const int c = lv.offset + ny * lv.cols + nx;
+          for (int k = cellStart_[c]; k < cellStart_[c + 1]; k++) {
+            const int j = sorted_[k];
+            if (l == own && j <= static_cast<int>(i)) continue;
+            fn(j);
+          }
+        }
+      }
+    }
+  }
+
+  int levelCount() const noexcept { return levelCount_; }
+  // occupancy of the last build, across all levels
+  int maxCellCount() const noexcept { return maxCellCount_; }
+  int occupiedCells() const noexcept { return occupiedCells_; }
+
+ private:
+  struct Level {
+    float cellSize, invCellSize;
+    int cols, rows;
+    int offset;  // first cell of this level in cellStart_
+    size_t count;
+  };
+
+  Level levels_[MAX_LEVELS];
+  int levelCount_ = 0;
+  int maxCellCount_ = 0;
+  int occupiedCells_ = 0;
+  std::vector<int> cellStart_, cellOf_, sorted_;
+  std::vector<uint8_t> levelOf_;
+
+  // cells along one axis, clamped to [1, MAX_LEVEL_CELLS] before any int
+  // conversion can overflow
+  static int64_t axisCells(float extent, float cellSize) noexcept {
+    const double c = std::ceil(double(extent) / cellSize);
+    return static_cast<int64_t>(
+        std::clamp(c, 1.0, static_cast<double>(MAX_LEVEL_CELLS)));
+  }
+
+  static int cellIndex(const Level& lv, float x, float y) noexcept {
+    const int cx = std::clamp(static_cast<int>(x * lv.invCellSize), 0, lv.cols - 1);
+    const int cy = std::clamp(static_cast<int>(y * lv.invCellSize), 0, lv.rows - 1);
+    return cy * lv.cols + cx;
+  }
+};
+
+#endif
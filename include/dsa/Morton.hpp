@@ -0,0 +1,21 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+
+// spreads the low 16 bits of v out to the even bits
+constexpr uint32_t mortonPart1By1(uint32_t v) noexcept {
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Z-order code of a 2D cell coordinate (16 bits per axis)
+constexpr uint32_t mortonEncode(uint32_t x, uint32_t y) noexcept {
+  return mortonPart1By1(x) | (mortonPart1By1(y) << 1);
+}
+
+#endif
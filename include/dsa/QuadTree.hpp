@@ -1,90 +1,140 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <dsa/AABB.hpp>
 #include <vector>
 
-template <typename T>
+// flat quadtree over item indices. nodes live in one array and point at their
+// children by index; every node owns a contiguous range of the item buffer
+// (leaves hold their own items, internal nodes the union of their children).
+// build() reuses the previous frame's storage, so once the buffers have grown
+// to fit, rebuilding and querying never touch the heap
 class QuadTree {
  public:
-  QuadTree(AABBf bound, size_t cap)
-      : capacity_(cap),
-        boundary_(bound),
-        ul_(nullptr),
-        ur_(nullptr),
-        bl_(nullptr),
-        br_(nullptr) {
-    data_.reserve(cap);
+  static constexpr int MAX_DEPTH = 16;
+
+  struct Node {
+    float minX, minY, maxX, maxY;
+    int firstChild;  // ul, ur, bl, br are firstChild + 0..3; -1 for leaves
+    uint32_t begin, end;
   };
-  ~QuadTree() {
-    delete ul_;
-    delete ur_;
-    delete bl_;
-    delete br_;
-  }
 
-  bool insert(T* p) {
-    const Vec2f pos(p->position.x, p->position.y);
-    if (!boundary_.contains(pos)) {
-      return false;
+  // partitions items [0, n) located at (xs[i], ys[i]) inside bound until every
+  // leaf holds at most bucketSize items (or MAX_DEPTH is reached)
+  void build(const float* xs, const float* ys, size_t n, const AABBf& bound,
+             size_t bucketSize) {
+    bucketSize_ = std::max<size_t>(bucketSize, 1);
+    depth_ = 0;
+    nodes_.clear();
+    items_.resize(n);
+    for (size_t i = 0; i < n; i++) items_[i] = static_cast<uint32_t>(i);
+
+    nodes_.push_back({bound.min.x, bound.min.y, bound.max.x, bound.max.y, -1,
+                      0, static_cast<uint32_t>(n)});
+    subdivide(0, xs, ys, 0);
+
+    // positions in item order, so leaf scans read contiguous memory
+    itemX_.resize(n);
+    itemY_.resize(n);
+    for (size_t k = 0; k < n; k++) {
+      itemX_[k] = xs[items_[k]];
+      itemY_[k] = ys[items_[k]];
     }
+  }
 
-    if (!divided_ && data_.size() < capacity_) {
-      data_.push_back(p);
-      return true;
+  // appends every item inside qRange to res. res is not cleared, so callers
+  // can keep one buffer alive across queries
+  void query(std::vector<uint32_t>& res, const AABBf& qRange) const {
+    if (nodes_.empty()) return;
+
+    int stack[4 * MAX_DEPTH + 4];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+      const Node& node = nodes_[stack[--top]];
+      if (qRange.min.x > node.maxX || qRange.max.x < node.minX ||
+          qRange.min.y > node.maxY || qRange.max.y < node.minY) {
+        continue;
+      }
+
+      // fully covered, take everything below without testing positions
+      if (qRange.min.x <= node.minX && qRange.max.x >= node.maxX &&
+          qRange.min.y <= node.minY && qRange.max.y >= node.maxY) {
+        res.insert(res.end(), items_.begin() + node.begin,
+                   items_.begin() + node.end);
+        continue;
+      }
+
+      if (node.firstChild < 0) {
+        for (uint32_t k = node.begin; k < node.end; k++) {
+          if (qRange.contains({itemX_[k], itemY_[k]})) res.push_back(items_[k]);
+        }
+        continue;
+      }
+
+      for (int c = 0; c < 4; c++) stack[top++] = node.firstChild + c;
     }
+  }
 
-    if (!divided_) {
-      subdivide();
+  // calls fn(node, items, count) for every non-empty leaf
+  template <typename Fn>
+  void forEachLeaf(Fn&& fn) const {
+    for (const Node& node : nodes_) {
+      if (node.firstChild >= 0 || node.begin == node.end) continue;
+      fn(node, items_.data() + node.begin, node.end - node.begin);
     }
+  }
 
-    if (ul_ && ul_->insert(p)) return true;
-    if (ur_ && ur_->insert(p)) return true;
-    if (bl_ && bl_->insert(p)) return true;
-    if (br_ && br_->insert(p)) return true;
-    return false;
-  };
-
-  void query(std::vector<T*>& res, const AABBf& qRange) const {
-    if (!boundary_.intersects(qRange)) return;
-
-    for (T* p : data_) {
-      const Vec2f pos(p->position.x, p->position.y);
-      if (qRange.contains(pos)) res.push_back(p);
-    }
-
-    if (divided_) {
-      if (ul_) ul_->query(res, qRange);
-      if (ur_) ur_->query(res, qRange);
-      if (bl_) bl_->query(res, qRange);
-      if (br_) br_->query(res, qRange);
-    }
-  };
+  size_t nodeCount() const noexcept { return nodes_.size(); }
+  int depth() const noexcept { return depth_; }
 
  private:
-  size_t capacity_;
-  std::vector<T*> data_;
-  AABBf boundary_;
-  bool divided_ = false;
-
-  QuadTree *ul_, *ur_, *bl_, *br_;
-
-  void subdivide() {
-    const float x = boundary_.min.x, y = boundary_.min.y;
-    const float w = 0.5f * boundary_.width(), h = 0.5f * boundary_.height();
-
-    ul_ = new QuadTree(AABBf({x, y}, {w, h}), capacity_);
-    ur_ = new QuadTree(AABBf({x + w, y}, {w, h}), capacity_);
-    bl_ = new QuadTree(AABBf({x, y + h}, {w, h}), capacity_);
-    br_ = new QuadTree(AABBf({x + w, y + h}, {w, h}), capacity_);
-
-    divided_ = true;
-
-    std::vector<T*> old = std::move(data_);
-    for (T* p : old) {
-      insert(p);
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> items_;
+  std::vector<float> itemX_, itemY_;
+  size_t bucketSize_ = 16;
+  int depth_ = 0;
+
+  void subdivide(int nodeIdx, const float* xs, const float* ys, int depth) {
+    depth_ = std::max(depth_, depth);
+    const Node node = nodes_[nodeIdx];
+    if (node.end - node.begin <= bucketSize_ || depth >= MAX_DEPTH) return;
+
+    const float midX = 0.5f * (node.minX + node.maxX);
+    const float midY = 0.5f * (node.minY + node.maxY);
+
+    // split top/bottom, then each half left/right: ul | ur | bl | br
+    uint32_t* first = items_.data() + node.begin;
+    uint32_t* last = items_.data() + node.end;
+    uint32_t* midRow =
+        std::partition(first, last, [&](uint32_t i) { return ys[i] < midY; });
+    uint32_t* topSplit =
+        std::partition(first, midRow, [&](uint32_t i) { return xs[i] < midX; });
+    uint32_t* botSplit =
+        std::partition(midRow, last, [&](uint32_t i) { return xs[i] < midX; });
+
+    const uint32_t base = static_cast<uint32_t>(first - items_.data());
+    const uint32_t b0 = node.begin;
+    const uint32_t b1 = base + static_cast<uint32_t>(topSplit - first);
+    const uint32_t b2 = base + static_cast<uint32_t>(midRow - first);
+    const uint32_t b3 = base + static_cast<uint32_t>(botSplit - first);
+    const uint32_t b4 = node.end;
+
+    const int firstChild = static_cast<int>(nodes_.size());
+    nodes_[nodeIdx].firstChild = firstChild;
+    nodes_.push_back({node.minX, node.minY, midX, midY, -1, b0, b1});
+    nodes_.push_back({midX, node.minY, node.maxX, midY, -1, b1, b2});
+    nodes_.push_back({node.minX, midY, midX, node.maxY, -1, b2, b3});
+    nodes_.push_back({midX, midY, node.maxX, node.maxY, -1, b3, b4});
+
+    for (int c = 0; c < 4; c++) {
+      subdivide(firstChild + c, xs, ys, depth + 1);
     }
-  };
+  }
 };
 
 #endif
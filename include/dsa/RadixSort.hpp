@@ -0,0 +1,44 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LSD radix sort of (key, value) pairs by 32-bit key, 8 bits per pass. stable,
+// and passes where every key shares the same digit are skipped. tmpKeys and
+// tmpValues are scratch space the caller keeps around between calls
+inline void radixSortPairs(std::vector<uint32_t>& keys,
+                           std::vector<uint32_t>& values,
+                           std::vector<uint32_t>& tmpKeys,
+                           std::vector<uint32_t>& tmpValues) {
+  const size_t n = keys.size();
+  tmpKeys.resize(n);
+  tmpValues.resize(n);
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    size_t count[257] = {};
+    for (size_t i = 0; i < n; i++) count[((keys[i] >> shift) & 0xff) + 1]++;
+
+    // every key has the same digit, this pass would be a copy
+    bool trivial = false;
+    for (size_t d = 1; d <= 256; d++) {
+      if (count[d] == n) {
+        trivial = true;
+        break;
+      }
+    }
+    if (trivial) continue;
+
+    for (size_t d = 1; d <= 256; d++) count[d] += count[d - 1];
+    for (size_t i = 0; i < n; i++) {
+      const size_t dst = count[(keys[i] >> shift) & 0xff]++;
+      tmpKeys[dst] = keys[i];
+      tmpValues[dst] = values[i];
+    }
+    keys.swap(tmpKeys);
+    values.swap(tmpValues);
+  }
+}
+
+#endif
@@ -1,32 +1,61 @@
 #ifndef SPATIALGRID_H
 #define SPATIALGRID_H
 
+#include <ThreadPool.hpp>
 #include <algorithm>
 #include <cstddef>
 #include <dsa/Vec2.hpp>
 #include <vector>
 
+// how items are binned into cells
+enum class GridLayout {
+  LinkedList,    // head/next singly linked list per cell
+  CountingSort,  // item indices sorted by cell into one contiguous array
+};
+
 struct SpatialGrid {
-  float invCellSize;
+  float cellSize, invCellSize;
   int cols, rows, nCells;
+  GridLayout layout = GridLayout::LinkedList;
 
-  std::vector<int> head, next;
+  // LinkedList. touched lists the cells the last build made non-empty, so
+  // the next one only has to reset those heads
+  std::vector<int> head, next, touched;
   size_t headSize = 0, nextSize = 0;
 
-  inline void configure(float cellSize, Vec2f worldSize) noexcept {
+  // CountingSort: the items in cell c are sorted[cellStart[c]] up to (not
+  // including) sorted[cellStart[c + 1]]. cellCount is the histogram scratch
+  // and is all zeros between builds
+  std::vector<int> cellStart, cellCount, sorted, cellOf, blockSums;
+
+  inline void configure(float size, Vec2f worldSize) noexcept {
+    cellSize = size;
     invCellSize = 1.0f / cellSize;
-    cols = worldSize.x * invCellSize;
-    rows = worldSize.y * invCellSize;
+    // a world narrower than one cell still gets one, so cellIndex always
+    // has a cell to clamp into
+    cols = std::max(1, static_cast<int>(worldSize.x * invCellSize));
+    rows = std::max(1, static_cast<int>(worldSize.y * invCellSize));
     nCells = cols * rows;
   };
 
   inline void resize(size_t numItems) noexcept {
+    if (layout == GridLayout::CountingSort) {
+      if (cellCount.size() != static_cast<size_t>(nCells)) {
+        cellStart.resize(static_cast<size_t>(nCells) + 1);
+        cellCount.assign(nCells, 0);
+      }
+      sorted.resize(numItems);
+      cellOf.resize(numItems);
+      return;
+    }
+
     if (headSize != static_cast<size_t>(nCells)) {
       head.assign(nCells, -1);
       headSize = nCells;
     } else {
-      std::fill(head.begin(), head.end(), -1);
+      for (int c : touched) head[c] = -1;
     }
+    touched.clear();
 
     if (nextSize != numItems) {
       nextSize = numItems;
@@ -34,12 +63,25 @@ struct SpatialGrid {
     }
   }
 
-  template <typename T>
-  inline void build(std::vector<T>& items) noexcept {
-    for (size_t i = 0; i < items.size(); i++) {
-      const Vec2f& pos = items[i].position;
-      int cx = static_cast<int>(pos.x * invCellSize);
-      int cy = static_cast<int>(pos.y * invCellSize);
+  inline int cellIndex(float x, float y) const noexcept {
+    const int cx = std::clamp(static_cast<int>(x * invCellSize), 0, cols - 1);
+    const int cy = std::clamp(static_cast<int>(y * invCellSize), 0, rows - 1);
+    return cy * cols + cx;
+  }
+
+  inline void build(const float* xs, const float* ys, size_t n,
+                    ThreadPool& pool) noexcept {
+    if (layout == GridLayout::CountingSort) {
+      buildSorted(xs, ys, n, pool);
+    } else {
+      buildLinked(xs, ys, n);
+    }
+  }
+
+  inline void buildLinked(const float* xs, const float* ys, size_t n) noexcept {
+    for (size_t i = 0; i < n; i++) {
+      int cx = static_cast<int>(xs[i] * invCellSize);
+      int cy = static_cast<int>(ys[i] * invCellSize);
       cx = std::clamp(cx, 0, cols - 1);
       cy = std::clamp(cy, 0, rows - 1);
 
@@ -47,11 +89,102 @@ struct SpatialGrid {
       const int c = cy * cols + cx;
 
       // push_front operation
+      if (head[c] == -1) touched.push_back(c);
       next[i] = head[c];
       head[c] = i;
     }
   }
 
+  // counting sort: bin -> histogram -> exclusive prefix sum -> scatter.
+  // binning and the prefix sum run on the pool; the histogram and scatter stay
+  // serial so items within a cell keep ascending index order
+  inline void buildSorted(const float* xs, const float* ys, size_t n,
+                          ThreadPool& pool) noexcept {
+    constexpr size_t GRAIN = 8192;
+    int* start = cellStart.data();
+    int* count = cellCount.data();
+    int* cell = cellOf.data();
+
+    pool.parallelFor(0, n, GRAIN, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; i++) cell[i] = cellIndex(xs[i], ys[i]);
+    });
+
+    for (size_t i = 0; i < n; i++) count[cell[i]]++;
+
+    // blocked scan: per-block totals, scan of the totals, then local scans
+    const size_t cells = nCells;
+    const size_t blocks =
+        std::min(pool.size() * 4, (cells + GRAIN - 1) / GRAIN);
+    if (blocks <= 1) {
+      int sum = 0;
+      for (size_t c = 0; c < cells; c++) {
+        start[c] = sum;
+        sum += count[c];
+      }
+    } else {
+      blockSums.assign(blocks + 1, 0);
+      pool.run(blocks, [&](size_t blk) {
+        const size_t b = cells * blk / blocks, e = cells * (blk + 1) / blocks;
+        int sum = 0;
+        for (size_t c = b; c < e; c++) sum += count[c];
+        blockSums[blk + 1] = sum;
+      });
+      for (size_t blk = 0; blk < blocks; blk++) {
+        blockSums[blk + 1] += blockSums[blk];
+      }
+      pool.run(blocks, [&](size_t blk) {
+        const size_t b = cells * blk / blocks, e = cells * (blk + 1) / blocks;
+        int sum = blockSums[blk];
+        for (size_t c = b; c < e; c++) {
+          start[c] = sum;
+          sum += count[c];
+        }
+      });
+    }
+    start[cells] = static_cast<int>(n);
+
+    // scattering back to front with the histogram as a cursor leaves each
+    // cell in ascending order and the histogram zeroed for the next build
+    for (size_t i = n; i-- > 0;) {
+      const int c = cell[i];
+      sorted[start[c] + --count[c]] = static_cast<int>(i);
+    }
+  }
+
+  // calls fn(idx) for every item binned into cell c
+  template <typename Fn>
+  inline void forEachInCell(int c, Fn&& fn) const {
+    if (layout == GridLayout::CountingSort) {
+      const int* it = sorted.data() + cellStart[c];
+      const int* end = sorted.data() + cellStart[c + 1];
+      for (; it != end; ++it) fn(*it);
+    } else {
+      for (int idx = head[c]; idx != -1; idx = next[idx]) fn(idx);
+    }
+  }
+
+  // visits neighbors (idx > objIdx) in the 3x3 block around cell (cx, cy).
+  // unlike queryDoSomething this uses the cell an item was binned into
+  // during build, which is what the parallel solve partitions on
+  template <typename Fn>
+  inline void queryCell(size_t objIdx, int cx, int cy, Fn&& callback) const {
+    const int dxMin = (cx > 0) ? -1 : 0;
+    const int dxMax = (cx < cols - 1) ? 1 : 0;
+    const int dyMin = (cy > 0) ? -1 : 0;
+    const int dyMax = (cy < rows - 1) ? 1 : 0;
+
+    for (int dx = dxMin; dx <= dxMax; dx++) {
+      const int nx = cx + dx;
+      for (int dy = dyMin; dy <= dyMax; dy++) {
+        const int cn = (cy + dy) * cols + nx;
+        forEachInCell(cn, [&](int idx) {
+          if (idx <= static_cast<int>(objIdx)) return;
+          callback(idx);
+        });
+      }
+    }
+  }
+
   template <typename Fn>
   inline void queryDoSomething(size_t objIdx, const Vec2f& pos, Fn&& callback,
                                int scale = 1) {
@@ -85,17 +218,18 @@ struct SpatialGrid {
       for (int dy = dyMin; dy <= dyMax; dy++) {
         const int ny = cy + dy;
         const int cn = ny * cols + nx;
-        if (cn >= static_cast<int>(head.size())) continue;
+        if (cn < 0 || cn >= nCells) continue;
 
         // get the second particle
-        for (int idx = head[cn]; idx != -1; idx = next[idx]) {
+        forEachInCell(cn, [&](int idx) {
           // prune redundant checks
-          if (idx <= static_cast<int>(objIdx)) continue;
+          if (idx <= static_cast<int>(objIdx)) return;
           callback(idx);
-        }
+        });
       }
     }
   };
+
 };
 
 #endif
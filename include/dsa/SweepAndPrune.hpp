@@ -0,0 +1,118 @@
+#ifndef SWEEPANDPRUNE_H
+#define SWEEPANDPRUNE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 1D sweep and prune along x. items stay sorted by their min-x extent across
+// frames; since particles only move a little per step, re-sorting the previous
+// order with insertion sort is close to O(n). pairs are reported for every two
+// items whose x intervals overlap and whose y extents are within reach.
+// unlike SpatialGrid it needs no world bounds or cell size
+class SweepAndPrune {
+ public:
+  struct Entry {
+    float minX, maxX;
+    float y, r;
+    uint32_t idx;
+  };
+
+  // refreshes the extents of items [0, n) and restores the sort order.
+  // items added since the last update are sorted on their own and merged
+  // in, so a burst of spawns doesn't turn the insertion sort quadratic
+  void update(const float* xs, const float* ys, const float* radius,
+              size_t n) {
+    if (n < tracked_) clear();
+    for (size_t i = tracked_; i < n; i++) {
+      entries_.push_back({0.0f, 0.0f, 0.0f, 0.0f, static_cast<uint32_t>(i)});
+    }
+    tracked_ = n;
+
+    for (Entry& e : entries_) refresh(e, xs, ys, radius);
+
+    insertionSort(0, sorted_);
+    if (sorted_ < entries_.size()) {
+      std::sort(entries_.begin() + sorted_, entries_.end(), less);
+      std::inplace_merge(entries_.begin(), entries_.begin() + sorted_,
+                         entries_.end(), less);
+    }
+    sorted_ = entries_.size();
+  }
+
+  // items were physically reordered so that new[k] = old[order[k]]. rewrites
+  // the stored indices instead of throwing the sort order away; items that
+  // were never seen by update() are queued as new ones
+  void remap(const std::vector<uint32_t>& order) {
+    if (tracked_ == 0) return;
+    inverse_.resize(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+      inverse_[order[k]] = static_cast<uint32_t>(k);
+    }
+    for (Entry& e : entries_) e.idx = inverse_[e.idx];
+    for (size_t k = 0; k < order.size(); k++) {
+      if (order[k] >= tracked_) {
+        entries_.push_back({0.0f, 0.0f, 0.0f, 0.0f, static_cast<uint32_t>(k)});
+      }
+    }
+    tracked_ = order.size();
+  }
+
+  void clear() noexcept {
+    entries_.clear();
+    sorted_ = 0;
+    tracked_ = 0;
+  }
+
+  // calls fn(i, j) once for every candidate pair, using the extents captured
+  // by the last update()
+  template <typename Fn>
+  void forEachPair(Fn&& fn) const {
+    const size_t n = entries_.size();
+    for (size_t a = 0; a < n; a++) {
+      const Entry& ea = entries_[a];
+      for (size_t b = a + 1; b < n && entries_[b].minX <= ea.maxX; b++) {
+        const Entry& eb = entries_[b];
+        const float reach = ea.r + eb.r;
+        if (eb.y - ea.y > reach || ea.y - eb.y > reach) continue;
+        fn(ea.idx, eb.idx);
+      }
+    }
+  }
+
+  size_t size() const noexcept { return entries_.size(); }
+
+ private:
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> inverse_;
+  size_t sorted_ = 0;   // entries_[0, sorted_) are in min-x order
+  size_t tracked_ = 0;  // items [0, tracked_) have an entry
+
+  static bool less(const Entry& a, const Entry& b) noexcept {
+    return a.minX < b.minX;
+  }
+
+  static void refresh(Entry& e, const float* xs, const float* ys,
+                      const float* radius) noexcept {
+    const float r = radius[e.idx];
+    e.minX = xs[e.idx] - r;
+    e.maxX = xs[e.idx] + r;
+    e.y = ys[e.idx];
+    e.r = r;
+  }
+
+  void insertionSort(size_t begin, size_t end) noexcept {
+    for (size_t k = begin + 1; k < end; k++) {
+      const Entry e = entries_[k];
+      size_t m = k;
+      while (m > begin && e.minX < entries_[m - 1].minX) {
+        entries_[m] = entries_[m - 1];
+        m--;
+      }
+      entries_[m] = e;
+    }
+  }
+};
+
+#endif
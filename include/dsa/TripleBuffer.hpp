@@ -0,0 +1,39 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// single producer / single consumer hand-off of the latest value. the writer
+// fills back() and publishes it; the reader picks up whatever was published
+// last. neither side ever blocks or sees a slot the other one is using:
+// the three slots rotate through an atomic "middle" index
+template <typename T>
+class TripleBuffer {
+ public:
+  // writer side
+  T& back() noexcept { return slots_[back_]; }
+  void publish() noexcept {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // reader side. swaps in the newest published slot, if there is one, and
+  // returns whether front() changed
+  bool acquire() noexcept {
+    if (!(middle_.load(std::memory_order_relaxed) & FRESH)) return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  const T& front() const noexcept { return slots_[front_]; }
+
+ private:
+  static constexpr uint8_t INDEX = 3;
+  static constexpr uint8_t FRESH = 4;
+
+  T slots_[3];
+  alignas(64) uint8_t back_ = 0;
+  alignas(64) std::atomic<uint8_t> middle_{1};
+  alignas(64) uint8_t front_ = 2;
+};
+
+#endif
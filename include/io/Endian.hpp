@@ -0,0 +1,79 @@
+#ifndef ENDIAN_H
+#define ENDIAN_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// explicit little-endian encoding for the on-disk formats in io/
+
+inline bool hostIsLittleEndian() noexcept {
+  const uint16_t probe = 1;
+  uint8_t first;
+  std::memcpy(&first, &probe, 1);
+  return first == 1;
+}
+
+inline void put32(uint8_t* dst, uint32_t v) noexcept {
+  for (int b = 0; b < 4; b++) dst[b] = static_cast<uint8_t>(v >> (8 * b));
+}
+
+inline void put64(uint8_t* dst, uint64_t v) noexcept {
+  for (int b = 0; b < 8; b++) dst[b] = static_cast<uint8_t>(v >> (8 * b));
+}
+
+inline void putF32(uint8_t* dst, float f) noexcept {
+  uint32_t v;
+  std::memcpy(&v, &f, 4);
+  put32(dst, v);
+}
+
+inline uint32_t get32(const uint8_t* src) noexcept {
+  uint32_t v = 0;
+  for (int b = 0; b < 4; b++) v |= static_cast<uint32_t>(src[b]) << (8 * b);
+  return v;
+}
+
+inline uint64_t get64(const uint8_t* src) noexcept {
+  uint64_t v = 0;
+  for (int b = 0; b < 8; b++) v |= static_cast<uint64_t>(src[b]) << (8 * b);
+  return v;
+}
+
+inline float getF32(const uint8_t* src) noexcept {
+  const uint32_t v = get32(src);
+  float f;
+  std::memcpy(&f, &v, 4);
+  return f;
+}
+
+// LEB128 varints and zigzag for signed deltas, so small values take a byte
+inline void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// reads one varint from [src, end); returns nullptr if it runs off the end
+inline const uint8_t* getVarint(const uint8_t* src, const uint8_t* end,
+                                uint64_t& v) noexcept {
+  v = 0;
+  for (int shift = 0; src < end && shift < 64; shift += 7) {
+    const uint8_t b = *src++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) return src;
+  }
+  return nullptr;
+}
+
+inline uint64_t zigzag(int64_t v) noexcept {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) noexcept {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <Simulator.hpp>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+// binary save/restore of a whole Simulator: settings plus every particle
+// array, so a settled scene can be restored in milliseconds.
+//
+// file layout, all little-endian:
+//   0   char[8]  magic "RPESNAP\0"
+//   8   u32      version
+//   12  u32      number of arrays
+//   16  u64      particle count
+//   24  f32 x6   world width, world height, gravity, restitution, dt,
+//                max particle radius
+//   48  u32 x3   integration type, broadphase type, substeps
+//   60  u32      reserved (0)
+//   64  array table, one 16 byte entry per array:
+//         char[4] tag (see ParticleStore::forEachArray), u32 element size,
+//         u64 file offset
+//   then the arrays themselves, each starting on a 64 byte boundary.
+//
+// arrays are stored exactly as the ParticleStore holds them, so loading is
+// an mmap plus one memcpy per array. unknown tags are skipped; missing
+// optional arrays (last position, acceleration, rest counters) are rebuilt
+class Snapshot {
+ public:
+  static constexpr uint32_t VERSION = 1;
+
+  // serialises sim into a file image. cheap (one copy of the arrays), so it
+  // can run between steps while the slow part happens elsewhere
+  static std::vector<uint8_t> capture(const Simulator& sim);
+
+  // throw std::runtime_error if the file can't be written
+  static void save(const Simulator& sim, const std::string& path);
+  static void write(const std::vector<uint8_t>& image, const std::string& path);
+
+  // captures now and writes on a background thread. the future rethrows
+  // write errors from get()
+  static std::future<void> saveAsync(const Simulator& sim,
+                                     const std::string& path);
+
+  // replaces sim's particles and settings with the file's. throws
+  // std::runtime_error, leaving sim untouched, if the file is unreadable,
+  // truncated or of another version
+  static void load(Simulator& sim, const std::string& path);
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <ParticleStore.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <io/MappedFile.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// per-frame particle positions on disk, small enough to keep every frame.
+//
+// positions are quantized to a fixed precision and stored as deltas against
+// the same particle id in the previous frame, as zigzag varints; a particle
+// that barely moved costs about 3 bytes. frames are grouped into chunks whose
+// first frame is encoded against zero, so every chunk decodes on its own, and
+// an index of chunk offsets at the end of the file makes seeking cheap.
+//
+// file layout, all little-endian:
+//   header  char[8] "RPETRAJ\0", u32 version, u32 frames per chunk,
+//           f32 precision, f32 dt, u64 frame count (rewritten after every
+//           chunk, so an unclosed file still knows its dt)
+//   chunks  u32 frame count, u32 byte length, frames:
+//             varint step, varint particle count, then per particle in id
+//             order: varint id gap, zigzag dx, zigzag dy, and f32 radius the
+//             first time an id appears in the chunk
+//   index   per chunk: u64 offset, u64 first frame, u32 frames, u32 0
+//   footer  u64 index offset, u32 chunk count, u32 0, char[8] "RPETIDX\0"
+
+// one decoded frame, in id order
+struct TrajectoryFrame {
+  uint64_t step = 0;
+  std::vector<float> x, y, radius;
+  std::vector<uint32_t> id;
+
+  // replays have no in-between state, so last == current
+  ParticleView view() const noexcept {
+    return {x.data(),      y.data(),  x.data(), y.data(),
+            radius.data(), id.data(), x.size()};
+  }
+};
+
+// hands frames from the simulation to a background writer. capture() only
+// copies the arrays into a recycled buffer; quantizing, encoding and I/O
+// happen on the writer thread. when the writer falls behind and every
+// buffer is in flight, frames are dropped (and counted) unless
+// Options::dropWhenFull is off, in which case capture() waits
+class TrajectoryRecorder {
+ public:
+  struct Options {
+    float precision;        // position quantum in world units
+    size_t framesPerChunk;  // frames between seek points
+    size_t queueFrames;     // frame buffers shared with the writer
+    bool dropWhenFull;
+  };
+  static constexpr Options DEFAULT_OPTIONS = {1.0f / 64.0f, 16, 8, true};
+
+  // throws std::runtime_error if path can't be created
+  explicit TrajectoryRecorder(const std::string& path,
+                              const Options& opts = DEFAULT_OPTIONS);
+  ~TrajectoryRecorder();
+
+  TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+  TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+  void capture(const ParticleView& particles, uint64_t step, float dt);
+
+  // drains the queue and writes the index. called by the destructor
+  void close();
+
+  uint64_t framesWritten() const;
+  uint64_t framesDropped() const;
+
+ private:
+  struct Frame {
+    uint64_t step;
+    float dt;
+    std::vector<float> x, y, radius;
+    std::vector<uint32_t> id;
+  };
+  struct ChunkEntry {
+    uint64_t offset, firstFrame;
+    uint32_t frames;
+  };
+
+  Options opts_;
+  std::ofstream out_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;  // writer waits for frames
+  std::condition_variable freed_;  // capture waits for buffers
+  std::deque<std::unique_ptr<Frame>> queue_;
+  std::vector<std::unique_ptr<Frame>> free_;
+  bool closing_ = false;
+  bool closed_ = false;
+  uint64_t written_ = 0;
+  uint64_t dropped_ = 0;
+  std::thread writer_;
+
+  // writer thread state
+  float invPrecision_;
+  float dt_ = 0.0f;
+  std::vector<uint8_t> chunk_;
+  uint32_t chunkFrames_ = 0;
+  std::vector<ChunkEntry> index_;
+  std::vector<int32_t> lastQx_, lastQy_;
+  std::vector<uint8_t> seen_;
+  std::vector<uint32_t> slotOf_;
+
+  void writerLoop();
+  void encode(const Frame& f);
+  void flushChunk();
+  void writeHeader(uint64_t frames);
+};
+
+// decodes a recorded trajectory. reading frames in order costs one frame of
+// decoding each; jumping (including backwards) restarts from the start of
+// the chunk holding the target frame. files from a recorder that never got
+// to close() are still readable up to their last complete chunk
+class TrajectoryReader {
+ public:
+  // throws std::runtime_error if the file isn't a trajectory
+  explicit TrajectoryReader(const std::string& path);
+
+  size_t frameCount() const noexcept { return frames_; }
+  float dt() const noexcept { return dt_; }
+  float precision() const noexcept { return precision_; }
+
+  // throws std::runtime_error on corrupt data or f >= frameCount()
+  void readFrame(size_t f, TrajectoryFrame& out);
+
+  // hints the OS to page in the chunk holding frame f
+  void prefetch(size_t f) const noexcept;
+
+ private:
+  struct ChunkEntry {
+    uint64_t offset, firstFrame;
+    uint32_t frames;
+  };
+
+  MappedFile file_;
+  float precision_ = 1.0f;
+  float dt_ = 0.0f;
+  size_t frames_ = 0;
+  std::vector<ChunkEntry> index_;
+
+  // decoding cursor
+  size_t chunk_ = SIZE_MAX;
+  size_t nextFrame_ = 0;
+  const uint8_t* cursor_ = nullptr;
+  const uint8_t* chunkEnd_ = nullptr;
+  std::vector<int32_t> lastQx_, lastQy_;
+  std::vector<float> radius_;
+  std::vector<uint8_t> seen_;
+
+  void scanChunks(size_t from);
+  size_t chunkOf(size_t f) const noexcept;
+  void startChunk(size_t c);
+  void decodeFrame(TrajectoryFrame& out);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// fused per-particle kernels. each one does gravity + integration + wall
+// clamping/reflection (unless KernelParams::walls is off) in a single pass
+// over the SoA arrays, using AVX2 or SSE2 blends where available. the level
+// is picked at runtime from what the CPU supports and can be lowered for
+// benchmarking. sleeping particles (rest at or above sleepSteps) keep their
+// position and velocity and only have their acceleration cleared
+
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+struct KernelArrays {
+  float* x;
+  float* y;
+  float* prevX;
+  float* prevY;
+  float* vx;
+  float* vy;
+  float* ax;
+  float* ay;
+  const float* radius;
+  const uint32_t* rest;
+};
+
+struct KernelParams {
+  float dt;
+  float gravity;
+  float width;
+  float height;
+  float restitution;
+  uint32_t sleepSteps;  // rest counts stay far below INT32_MAX
+  bool walls;           // off when the broad-phase handles walls itself
+};
+
+namespace simd {
+
+// best level this CPU supports
+SimdLevel detect() noexcept;
+
+// level the kernels currently dispatch to
+SimdLevel level() noexcept;
+
+// request a level; anything above detect() is clamped down to it
+void setLevel(SimdLevel level) noexcept;
+
+const char* name(SimdLevel level) noexcept;
+
+// position-based: x' = x + (x - prev) + a * dt^2, walls reflect prev
+void integrateVerlet(const KernelArrays& a, size_t begin, size_t end,
+                     const KernelParams& p) noexcept;
+
+// explicit Euler on vx/vy, walls reflect velocity
+void integrateEuler(const KernelArrays& a, size_t begin, size_t end,
+                    const KernelParams& p) noexcept;
+
+}  // namespace simd
+
+#endif
@@ -3,20 +3,35 @@
 
 #define PI 3.14159265
 
+#include <Profiler.hpp>
 #include <SFML/Graphics.hpp>
+#include <SimulationThread.hpp>
 #include <Simulator.hpp>
+#include <ThreadPool.hpp>
 #include <array>
+#include <future>
+#include <io/Trajectory.hpp>
+#include <memory>
 #include <ui/Slider.hpp>
 
 class Renderer {
  public:
+  // how each particle becomes vertices
+  enum class ParticleRenderMode {
+    TexturedQuads,  // two triangles sampling particleTexture_, 6 vertices
+    TriangleFans,   // tessellated circle, up to MAX_CIRCLE_SEGMENTS * 3
+  };
+
   struct Options {
     unsigned fps_limit;
     std::string window_title;
+    // run physics on its own thread at a fixed step instead of once per
+    // frame (can also be toggled with T)
+    bool threaded_simulation;
   };
 
-  Renderer(Simulator& sim, const Options& opts = {60, "RPEngine"});
-  ~Renderer() = default;
+  Renderer(Simulator& sim, const Options& opts = {60, "RPEngine", false});
+  ~Renderer();
 
   bool isOpen() const noexcept { return window_.isOpen(); };
   void pollAndHandleEvents() noexcept;
@@ -24,16 +39,37 @@ class Renderer {
 
   sf::Vector2u windowSize() const noexcept { return window_.getSize(); };
 
+  // when true the simulation thread steps the Simulator and main must not
+  void setThreadedSimulation(bool threaded);
+  bool threadedSimulation() const noexcept {
+    return simThread_ && simThread_->running();
+  }
+
+  void setRenderMode(ParticleRenderMode mode) noexcept { renderMode_ = mode; }
+  ParticleRenderMode renderMode() const noexcept { return renderMode_; }
+
+  // records every simulator step to a trajectory file (also toggled with C)
+  void setRecording(bool enabled);
+  bool recording() const noexcept { return recorder_ != nullptr; }
+
+  // draws a recorded trajectory instead of the simulator, which is left
+  // paused; main must not step it either. throws std::runtime_error if the
+  // file can't be read. also toggled with P
+  void startReplay(const std::string& path);
+  void stopReplay();
+  bool replaying() const noexcept { return replay_ != nullptr; }
+
  private:
   Simulator& sim_;
+  std::unique_ptr<SimulationThread> simThread_;
   sf::RenderWindow window_;
   sf::Vector2u lastSize_;
   sf::Vector2f pushOrigin_;  // tracks mouse position when held down
 
   // timers
   sf::Clock frameClock_;
-  sf::Clock spawnClock_;
   sf::Clock runtimeClock_;
+  sf::Clock replayClock_;
 
   // color lookup table
   std::vector<std::optional<sf::Color>> colorLUT_;
@@ -42,14 +78,32 @@ class Renderer {
   sf::Font font_;
   sf::Texture particleTexture_;
 
+  // slider values, handed to the simulator whenever they change
+  float gravity_ = 0.0f;
+  float restitution_ = 0.0f;
+  float syncedGravity_ = 0.0f;
+  float syncedRestitution_ = 0.0f;
+
   // --- UI components ---
   HorizSlider gSlider_;
   HorizSlider eSlider_;
   sf::Text particleCountText_;
   sf::Text fpsText_;
+  sf::Text replayText_;
 
   // vertex based circle drawing
-  sf::VertexArray particleVertices_;
+  ParticleRenderMode renderMode_ = ParticleRenderMode::TexturedQuads;
+  static constexpr unsigned PARTICLE_TEXTURE_SIZE = 64;
+  // vertices are staged in particleVertices_ and streamed to the GPU through
+  // particleBuffer_ when vertex buffers are available. slotIds_[k] is the id
+  // whose colour (and texture coords) slot k currently holds, so only
+  // positions are rewritten unless a slot changes hands
+  std::vector<sf::Vertex> particleVertices_;
+  sf::VertexBuffer particleBuffer_;
+  std::vector<uint32_t> slotIds_;
+  size_t verticesPerParticle_ = 0;
+  ThreadPool vertexPool_;
+  static constexpr size_t VERTEX_GRAIN = 4096;  // particles per chunk
   static constexpr size_t MIN_CIRCLE_SEGMENTS = 6;
   static constexpr size_t MAX_CIRCLE_SEGMENTS = 24;
   std::array<std::vector<sf::Vector2f>, MAX_CIRCLE_SEGMENTS + 1> unitCircle_;
@@ -59,14 +113,45 @@ class Renderer {
   bool draggingAny_ = false;
   bool radialPushing_ = false;
 
-  const float spawnInterval_ = 0.001f;
+  // R and Space run a simulator emitter at this many particles per second,
+  // F at five times it
+  static constexpr float SPAWN_RATE = 1000.0f;
   bool streamSpawn_ = false;
   bool randomSpawn_ = false;
   bool randomSpawnSUPERFAST_ = false;
   bool spawnMax_ = false;
-  std::mt19937 gen_;
-  std::uniform_real_distribution<float> distX;
-  std::uniform_real_distribution<float> distY;
+
+  // G lets the uniform grid re-pick its cell size from occupancy
+  bool adaptiveGrid_ = false;
+  // Z lets settled particles sleep
+  bool sleeping_ = false;
+
+  // quick save / load
+  const std::string snapshotPath_ = "snapshot.rpes";
+  std::future<void> pendingSave_;
+
+  // trajectory recording and replay
+  const std::string trajectoryPath_ = "trajectory.rpet";
+  std::unique_ptr<TrajectoryRecorder> recorder_;
+  std::unique_ptr<TrajectoryReader> replay_;
+  bool replayResumeThreaded_ = false;
+  double replayFrame_ = 0.0;  // playhead, fractional frames
+  float replaySpeed_ = 1.0f;  // recorded steps per real step, < 0 rewinds
+  bool replayPaused_ = false;
+  // the two frames around the playhead; replayLastX_/Y_ hold replayFrom_'s
+  // positions in replayTo_'s order so the normal interpolation applies
+  TrajectoryFrame replayFrom_, replayTo_;
+  size_t replayFromIndex_ = SIZE_MAX;
+  size_t replayToIndex_ = SIZE_MAX;
+  std::vector<float> replayLastX_, replayLastY_;
+
+  // profiler overlay (O) and trace export (J), with RPENGINE_PROFILE
+  const std::string tracePath_ = "trace.json";
+  bool showProfile_ = false;
+  float frameBudget_ = 1.0f / 60.0f;  // seconds the overlay bar spans
+  std::vector<Profiler::PhaseTotal> profilePhases_;
+  std::vector<sf::Text> profileLabels_;
+  static constexpr size_t MAX_PROFILE_LABELS = 10;
 
   // fps measurement
   static constexpr size_t FPS_SAMPLE_COUNT = 60;
@@ -75,27 +160,56 @@ class Renderer {
   bool samplesCollected_ = false;
 
   // --- helpers ---
+  bool buildParticleTexture();
+  // runs fn(sim) now, or between steps while the simulation thread owns it
+  template <typename Fn>
+  void withSim(Fn&& fn) {
+    if (threadedSimulation()) {
+      simThread_->post(std::forward<Fn>(fn));
+    } else {
+      fn(sim_);
+    }
+  }
+  // particles to draw and how far to lerp from lastX/lastY towards x/y
+  ParticleView particleView(float* alpha = nullptr) noexcept;
+  size_t particleCount() noexcept { return particleView().size(); }
+  void syncSettings();
+
   void computeUnitCircle();
   size_t getCircleSegments(float radius);
 
   const sf::Color getRainbow(float t) noexcept;
-  const sf::Color& colorFor(const Particle& p) noexcept;
+  const sf::Color& colorFor(uint32_t id) noexcept;
   void layoutUI() noexcept;
 
   void handleMousePressed(const sf::Event::MouseButtonPressed& e) noexcept;
   void handleMouseReleased() noexcept;
   void handleMouseMoved(const sf::Event::MouseMoved& e) noexcept;
   void handleKeyPressed(const sf::Event::KeyPressed& e) noexcept;
+  bool handleReplayKey(const sf::Event::KeyPressed& e) noexcept;
 
   void drawParticles();
+  void refreshSlots(const ParticleView& particles);
+  void writeQuadPositions(const ParticleView& particles, float alpha,
+                          size_t begin, size_t end) noexcept;
+  void writeFanPositions(const ParticleView& particles, float alpha,
+                         size_t segments, size_t begin, size_t end) noexcept;
   void drawComponents();
+  void drawProfile();
   void updateText() noexcept;
 
-  void randomSpawn() noexcept;
-  void randomSpawnSUPERFAST() noexcept;
-  void streamSpawn() noexcept;
+  void syncEmitters();
   void spawnMax() noexcept;
   void radialPush(const int scale);
+  void saveSnapshot();
+  void loadSnapshot();
+  void toggleRecording();
+  void toggleReplay();
+  void toggleProfile();
+  void exportTrace();
+  void advanceReplay();
+  void seekReplay(double frame) noexcept;
+  void loadReplayFrames(size_t from);
 };
 
 #endif
@@ -0,0 +1,242 @@
+#include <Profiler.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+// a ring entry. the owner fills it while readers may be copying it, so
+// every field is a relaxed atomic (plain loads and stores on x86/arm)
+struct ProfilerSlot {
+  std::atomic<const char*> name{nullptr};
+  std::atomic<uint64_t> start{0}, end{0};
+  std::atomic<uint32_t> depth{0};
+};
+
+// one per thread that ever recorded. the owner writes its ring without
+// locking: it bumps claimed, fills the slot, then bumps written. readers
+// take the mutex (which also guards name, summarize and alive), copy the
+// ring and drop whatever the owner claimed again while they were copying
+struct ProfilerThreadLog {
+  std::mutex mutex;
+  std::string name;
+  bool summarize = true;
+  bool alive = true;
+  uint32_t tid = 0;
+  uint32_t depth = 0;  // owner only
+  std::atomic<uint64_t> claimed{0}, written{0};
+  std::unique_ptr<ProfilerSlot[]> ring;
+};
+
+struct ProfilerRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ProfilerThreadLog>> logs;
+  uint32_t nextTid = 1;
+  Clock::time_point epoch = Clock::now();
+  std::atomic<uint64_t> frameStart{0}, frameEnd{0};
+};
+
+static ProfilerRegistry& registry() {
+  static ProfilerRegistry r;
+  return r;
+}
+
+// hands the thread's log back for reuse when the thread exits, so pools that
+// get recreated don't pile up rings
+struct ProfilerLogHandle {
+  ProfilerThreadLog* log = nullptr;
+  ~ProfilerLogHandle() {
+    if (!log) return;
+    std::lock_guard<std::mutex> lock(log->mutex);
+    log->alive = false;
+  }
+};
+
+static ProfilerThreadLog& threadLog() {
+  thread_local ProfilerLogHandle handle;
+  if (handle.log) return *handle.log;
+
+  ProfilerRegistry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  ProfilerThreadLog* log = nullptr;
+  for (const auto& l : r.logs) {
+    std::lock_guard<std::mutex> logLock(l->mutex);
+    if (!l->alive) {
+      log = l.get();
+      log->alive = true;
+      log->claimed.store(0, std::memory_order_relaxed);
+      log->written.store(0, std::memory_order_relaxed);
+      break;
+    }
+  }
+  if (!log) {
+    r.logs.push_back(std::make_unique<ProfilerThreadLog>());
+    log = r.logs.back().get();
+    log->ring = std::make_unique<ProfilerSlot[]>(Profiler::RING_EVENTS);
+  }
+  log->tid = r.nextTid++;
+  log->name = "thread " + std::to_string(log->tid);
+  log->summarize = true;
+  log->depth = 0;
+  handle.log = log;
+  return *log;
+}
+
+// the events still held by a ring, oldest first. the owner keeps writing
+// meanwhile, so the ring is copied first and any slot it claimed during the
+// copy is skipped
+template <typename Fn>
+static void forEachEvent(const ProfilerThreadLog& log, Fn&& fn) {
+  constexpr uint64_t size = Profiler::RING_EVENTS;
+  thread_local std::vector<Profiler::Event> copy;
+  const uint64_t written = log.written.load(std::memory_order_acquire);
+  const uint64_t first = written > size ? written - size : 0;
+  copy.clear();
+  for (uint64_t k = first; k < written; k++) {
+    const ProfilerSlot& s = log.ring[k % size];
+    copy.push_back({s.name.load(std::memory_order_relaxed),
+                    s.start.load(std::memory_order_relaxed),
+                    s.end.load(std::memory_order_relaxed),
+                    s.depth.load(std::memory_order_relaxed)});
+  }
+  // pairs with the owner's release fence: a slot whose new contents we saw
+  // is covered by the claimed count read after this
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t claimed = log.claimed.load(std::memory_order_relaxed);
+  const uint64_t valid = claimed > size ? claimed - size : 0;
+  for (uint64_t k = std::max(first, valid); k < written; k++) {
+    fn(copy[k - first]);
+  }
+}
+
+static void writeJsonString(std::ostream& os, const char* s) {
+  os << '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') os << '\\';
+    os << *s;
+  }
+  os << '"';
+}
+
+Profiler::Scope::Scope(const char* name) noexcept
+    : name_(name), start_(now()) {
+  threadLog().depth++;
+}
+
+Profiler::Scope::~Scope() {
+  const uint64_t end = now();
+  ProfilerThreadLog& log = threadLog();
+  const uint32_t depth = --log.depth;
+  const uint64_t k = log.written.load(std::memory_order_relaxed);
+  log.claimed.store(k + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ProfilerSlot& s = log.ring[k % RING_EVENTS];
+  s.name.store(name_, std::memory_order_relaxed);
+  s.start.store(start_, std::memory_order_relaxed);
+  s.end.store(end, std::memory_order_relaxed);
+  s.depth.store(depth, std::memory_order_relaxed);
+  log.written.store(k + 1, std::memory_order_release);
+}
+
+uint64_t Profiler::now() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now() - registry().epoch)
+      .count();
+}
+
+void Profiler::setThreadName(const char* name, bool summarize) {
+  if (!ENABLED) return;
+  ProfilerThreadLog& log = threadLog();
+  std::lock_guard<std::mutex> lock(log.mutex);
+  log.name = name;
+  log.summarize = summarize;
+}
+
+void Profiler::markFrame() noexcept {
+  ProfilerRegistry& r = registry();
+  r.frameStart.store(r.frameEnd.load());
+  r.frameEnd.store(now());
+}
+
+void Profiler::frameSummary(std::vector<PhaseTotal>& out) {
+  out.clear();
+  if (!ENABLED) return;
+  ProfilerRegistry& r = registry();
+  const uint64_t from = r.frameStart.load();
+  const uint64_t to = r.frameEnd.load();
+  if (from >= to) return;
+
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const auto& l : r.logs) {
+    std::lock_guard<std::mutex> logLock(l->mutex);
+    if (!l->summarize) continue;
+
+    // events land in the order they end, so every child is seen before its
+    // parent: childTime[d] collects the time of finished scopes at depth d
+    double childTime[MAX_DEPTH + 1] = {};
+    forEachEvent(*l, [&](const Event& e) {
+      const uint32_t d = std::min(e.depth, MAX_DEPTH - 1);
+      const double total = 1e-9 * static_cast<double>(e.end - e.start);
+      const double self = std::max(0.0, total - childTime[d + 1]);
+      childTime[d + 1] = 0.0;
+      childTime[d] += total;
+      if (e.end <= from || e.end > to) return;
+
+      auto it = std::find_if(out.begin(), out.end(), [&](const PhaseTotal& p) {
+        return std::strcmp(p.name, e.name) == 0;
+      });
+      if (it == out.end()) {
+        out.push_back({e.name, self});
+      } else {
+        it->seconds += self;
+      }
+    });
+  }
+  std::sort(out.begin(), out.end(),
+            [](const PhaseTotal& a, const PhaseTotal& b) {
+              return a.seconds > b.seconds;
+            });
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+  std::ofstream os(path, std::ios::trunc);
+  if (!os) throw std::runtime_error("Failed to write trace: " + path);
+
+  os << std::fixed;
+  os.precision(3);
+  os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  auto separator = [&]() -> std::ostream& {
+    os << (first ? "  " : ",\n  ");
+    first = false;
+    return os;
+  };
+
+  ProfilerRegistry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const auto& l : r.logs) {
+    std::lock_guard<std::mutex> logLock(l->mutex);
+    if (l->written.load(std::memory_order_acquire) == 0) continue;
+    separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                << "\"tid\": " << l->tid << ", \"args\": {\"name\": ";
+    writeJsonString(os, l->name.c_str());
+    os << "}}";
+
+    // trace timestamps are microseconds
+    forEachEvent(*l, [&](const Event& e) {
+      separator() << "{\"name\": ";
+      writeJsonString(os, e.name);
+      os << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << l->tid
+         << ", \"ts\": " << 1e-3 * static_cast<double>(e.start)
+         << ", \"dur\": " << 1e-3 * static_cast<double>(e.end - e.start)
+         << "}";
+    });
+  }
+  os << "\n]}\n";
+  if (!os) throw std::runtime_error("Failed to write trace: " + path);
+}
@@ -0,0 +1,74 @@
+#include <Profiler.hpp>
+#include <SimulationThread.hpp>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+SimulationThread::SimulationThread(Simulator& sim) : sim_(sim) {}
+
+SimulationThread::~SimulationThread() { stop(); }
+
+void SimulationThread::start() {
+  if (running_.exchange(true)) return;
+  publishSnapshot();
+  thread_ = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop() {
+  if (!running_.exchange(false)) return;
+  if (thread_.joinable()) thread_.join();
+  // leave nothing half-applied for whoever drives the simulator next
+  applyCommands();
+}
+
+void SimulationThread::post(Command cmd) {
+  std::lock_guard<std::mutex> lock(commandMutex_);
+  pending_.push_back(std::move(cmd));
+}
+
+void SimulationThread::loop() {
+  Profiler::setThreadName("simulation");
+  auto next = Clock::now();
+  while (running_.load(std::memory_order_relaxed)) {
+    applyCommands();
+    sim_.update();
+    steps_.fetch_add(1, std::memory_order_relaxed);
+    publishSnapshot();
+
+    // fixed step: sleep off whatever is left of dt. if physics can't keep
+    // up, run flat out but don't try to catch up on a long backlog
+    const auto dt = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(sim_.deltaTime()));
+    next += dt;
+    const auto now = Clock::now();
+    if (now - next > dt * MAX_STEP_LAG) {
+      next = now;
+    } else if (next > now) {
+      std::this_thread::sleep_until(next);
+    }
+  }
+}
+
+void SimulationThread::applyCommands() {
+  {
+    std::lock_guard<std::mutex> lock(commandMutex_);
+    executing_.swap(pending_);
+  }
+  for (Command& cmd : executing_) cmd(sim_);
+  executing_.clear();
+}
+
+void SimulationThread::publishSnapshot() {
+  const ParticleView p = sim_.particles();
+  RenderSnapshot& snap = snapshots_.back();
+  snap.x.assign(p.x, p.x + p.count);
+  snap.y.assign(p.y, p.y + p.count);
+  snap.lastX.assign(p.lastX, p.lastX + p.count);
+  snap.lastY.assign(p.lastY, p.lastY + p.count);
+  snap.radius.assign(p.radius, p.radius + p.count);
+  snap.id.assign(p.id, p.id + p.count);
+  snap.step = steps_.load(std::memory_order_relaxed);
+  snap.dt = sim_.deltaTime();
+  snap.publishedAt = Clock::now();
+  snapshots_.publish();
+}
@@ -1,9 +1,24 @@
+#include <Profiler.hpp>
 #include <Simulator.hpp>
+#include <simd/Kernels.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <dsa/Morton.hpp>
+#include <dsa/RadixSort.hpp>
+#include <io/Trajectory.hpp>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) noexcept {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
 
 Simulator::Simulator(Vec2f dims, float maxParticleRadius, float g, float C_r,
                      float dt, IntegrationType integrationType,
-                     BroadphaseType broadphaseType, size_t maxParticles)
+                     BroadphaseType broadphaseType, size_t maxParticles,
+                     size_t threads)
     : gravity(g),
       restitution(C_r),
       worldSize_(dims),
@@ -11,17 +26,80 @@ Simulator::Simulator(Vec2f dims, float maxParticleRadius, float g, float C_r,
       dt_(dt),
       integrationType_(integrationType),
       broadphaseType_(broadphaseType),
-      capacity_(maxParticles) {
+      capacity_(maxParticles),
+      pool_(std::make_unique<ThreadPool>(threads)) {
   std::random_device rd;
   gen_.seed(rd());
   particles_.reserve(maxParticles);
-  spatialGrid_.configure(2.0f * maxParticleRadius_, worldSize_);
+  configureGrid();
 };
 
 void Simulator::configure(Vec2f size, float dt) {
   worldSize_ = size;
   dt_ = dt;
-  spatialGrid_.configure(2.0f * maxParticleRadius_, worldSize_);
+  configureGrid();
+  wakeAll();
+}
+
+void Simulator::setWorldSize(Vec2f size) noexcept {
+  worldSize_ = size;
+  // the grid's outer cells have to line up with the walls again
+  configureGrid();
+  // sleepers skip the wall clamp, so they have to notice the walls moved
+  wakeAll();
+}
+
+void Simulator::configureGrid() {
+  spatialGrid_.configure(2.0f * maxParticleRadius_ * gridCellFactor_,
+                         worldSize_);
+  gridCurrent_ = false;
+}
+
+void Simulator::setAdaptiveGrid(bool on) {
+  adaptiveGrid_ = on;
+  gridTuneSolves_ = 0;
+  gridTuneCells_ = 0;
+  gridTuneMisses_ = 0;
+  if (!on && gridCellFactor_ != 1.0f) {
+    gridCellFactor_ = 1.0f;
+    configureGrid();
+  }
+}
+
+void Simulator::setSleeping(bool on) {
+  sleeping_ = on;
+  sleepGravity_ = gravity;
+  if (!on) wakeAll();
+}
+
+void Simulator::wakeAll() noexcept {
+  std::fill(particles_.rest.begin(), particles_.rest.end(), 0);
+  asleep_ = 0;
+}
+
+void Simulator::setThreadCount(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  if (threadCount() != threads) {
+    pool_ = std::make_unique<ThreadPool>(threads);
+  }
+}
+
+void Simulator::onParticlesReplaced() {
+  capacity_ = std::max(capacity_, particles_.size());
+  particles_.reserve(capacity_);
+  configureGrid();
+  gridTuneSolves_ = 0;
+  gridTuneCells_ = 0;
+  gridTuneMisses_ = 0;
+  sap_.clear();
+  framesSinceReorder_ = 0;
+  sizeAtReorder_ = 0;
+  accumulator_ = 0.0;
+
+  nextId_ = 0;
+  for (uint32_t id : particles_.id) nextId_ = std::max(nextId_, id + 1);
+  asleep_ = std::count_if(particles_.rest.begin(), particles_.rest.end(),
+                          [](uint32_t r) { return r >= SLEEP_STEPS; });
 }
 
 void Simulator::spawnParticle(Vec2f pos, Vec2f vel, float r, float m) noexcept {
@@ -31,162 +109,806 @@ void Simulator::spawnParticle(Vec2f pos, Vec2f vel, float r, float m) noexcept {
     std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
     vel = {dist(gen_), dist(gen_)};
   }
-  particles_.emplace_back(pos, vel, dt_, r, m);
+  Particle p(pos, vel, substepDt(), r, m);
+  p.id = nextId_++;
+  particles_.push(p);
+  gridCurrent_ = false;
 };
 
+size_t Simulator::appendSlots(size_t count) {
+  const size_t first = particles_.size();
+  particles_.grow(std::min(count, capacity_ - std::min(capacity_, first)));
+  return first;
+}
+
+void Simulator::finishSpawn(size_t first, float m) {
+  ParticleStore& ps = particles_;
+  const float dt = substepDt();
+  const float invMass = m == 0.0f ? 0.0f : 1.0f / m;
+  const uint32_t firstId = nextId_;
+  pool_->parallelFor(first, ps.size(), PARTICLE_GRAIN, [&](size_t begin,
+                                                          size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      ps.prevX[i] = ps.x[i] - ps.vx[i] * dt;
+      ps.prevY[i] = ps.y[i] - ps.vy[i] * dt;
+      ps.lastX[i] = ps.x[i];
+      ps.lastY[i] = ps.y[i];
+      ps.mass[i] = m;
+      ps.invMass[i] = invMass;
+      ps.id[i] = firstId + static_cast<uint32_t>(i - first);
+    }
+  });
+  nextId_ += static_cast<uint32_t>(ps.size() - first);
+  gridCurrent_ = false;
+}
+
+size_t Simulator::spawnParticles(const SpawnArrays& batch, float r,
+                                 float m) {
+  RPE_PROFILE_SCOPE("spawn");
+  ParticleStore& ps = particles_;
+  const size_t first = appendSlots(batch.count);
+  pool_->parallelFor(first, ps.size(), PARTICLE_GRAIN, [&](size_t begin,
+                                                          size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const size_t k = i - first;
+      ps.x[i] = batch.x[k];
+      ps.y[i] = batch.y[k];
+      ps.vx[i] = batch.vx ? batch.vx[k] : 0.0f;
+      ps.vy[i] = batch.vy ? batch.vy[k] : 0.0f;
+      ps.radius[i] = batch.radius ? batch.radius[k] : r;
+    }
+  });
+  finishSpawn(first, m);
+  return ps.size() - first;
+}
+
+// splitmix64, so each particle's random position is a pure function of the
+// batch seed and its index
+static uint64_t spawnHash(uint64_t v) noexcept {
+  v += 0x9e3779b97f4a7c15ull;
+  v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+  v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+  return v ^ (v >> 31);
+}
+
+size_t Simulator::spawnParticles(const SpawnPattern& pattern, size_t count,
+                                 float r, float m) {
+  RPE_PROFILE_SCOPE("spawn");
+  ParticleStore& ps = particles_;
+  const float s = pattern.spacing > 0.0f ? pattern.spacing : 2.0f * r;
+
+  // lattice: cols x rows centres, half a spacing in from the box edges
+  const size_t cols = static_cast<size_t>(std::max(0.0f, pattern.size.x / s));
+  const size_t rows = static_cast<size_t>(std::max(0.0f, pattern.size.y / s));
+
+  // hex disk: rows of centres inside the disk, from the top down. rowFirst
+  // holds the index of each row's first particle and a final total
+  struct HexRow {
+    float y, x0;
+  };
+  std::vector<HexRow> hexRows;
+  std::vector<size_t> rowFirst;
+  if (pattern.shape == SpawnPattern::Shape::HexDisk) {
+    const float R = pattern.diskRadius;
+    const float h = s * std::sqrt(3.0f) * 0.5f;
+    const int half = R > 0.0f ? static_cast<int>(R / h) : -1;
+    rowFirst.push_back(0);
+    for (int j = -half; j <= half; j++) {
+      const float dy = j * h;
+      const float w = std::sqrt(std::max(0.0f, R * R - dy * dy));
+      const float off = (j & 1) ? 0.5f * s : 0.0f;
+      const int iMin = static_cast<int>(std::ceil((-w - off) / s));
+      const int iMax = static_cast<int>(std::floor((w - off) / s));
+      if (iMax < iMin) continue;
+      hexRows.push_back(
+          {pattern.center.y + dy, pattern.center.x + off + iMin * s});
+      rowFirst.push_back(rowFirst.back() + (iMax - iMin + 1));
+    }
+  }
+
+  switch (pattern.shape) {
+    case SpawnPattern::Shape::Lattice:
+      count = std::min(count, cols * rows);
+      break;
+    case SpawnPattern::Shape::HexDisk:
+      count = std::min(count, rowFirst.back());
+      break;
+    case SpawnPattern::Shape::Random:
+      break;
+  }
+  uint64_t seed = 0;
+  if (pattern.shape == SpawnPattern::Shape::Random || pattern.jitter > 0.0f) {
+    seed = static_cast<uint64_t>(gen_()) << 32;
+    seed |= gen_();
+  }
+
+  const size_t first = appendSlots(count);
+  pool_->parallelFor(first, ps.size(), PARTICLE_GRAIN, [&](size_t begin,
+                                                          size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const size_t k = i - first;
+      Vec2f pos;
+      if (pattern.shape == SpawnPattern::Shape::Lattice) {
+        pos = pattern.min +
+              Vec2f((k % cols + 0.5f) * s, (k / cols + 0.5f) * s);
+      } else if (pattern.shape == SpawnPattern::Shape::HexDisk) {
+        const size_t row =
+            std::upper_bound(rowFirst.begin(), rowFirst.end(), k) -
+            rowFirst.begin() - 1;
+        pos = {hexRows[row].x0 + (k - rowFirst[row]) * s, hexRows[row].y};
+      } else {
+        // 24 bits per axis, exactly representable as floats in [0, 1)
+        const uint64_t bits = spawnHash(seed + k);
+        const float u = (bits >> 40) * (1.0f / 16777216.0f);
+        const float v = ((bits >> 16) & 0xffffff) * (1.0f / 16777216.0f);
+        pos = pattern.min + Vec2f(u * pattern.size.x, v * pattern.size.y);
+      }
+      ps.x[i] = pos.x;
+      ps.y[i] = pos.y;
+      Vec2f vel = pattern.velocity;
+      if (pattern.jitter > 0.0f) {
+        // hashed once more so it doesn't repeat the position's bits
+        const uint64_t bits = spawnHash(spawnHash(seed + k));
+        const float u = (bits >> 40) * (1.0f / 16777216.0f);
+        const float v = ((bits >> 16) & 0xffffff) * (1.0f / 16777216.0f);
+        vel += Vec2f(u * 2.0f - 1.0f, v * 2.0f - 1.0f) * pattern.jitter;
+      }
+      ps.vx[i] = vel.x;
+      ps.vy[i] = vel.y;
+      ps.radius[i] = r;
+    }
+  });
+  finishSpawn(first, m);
+  return ps.size() - first;
+}
+
+uint32_t Simulator::addEmitter(const Emitter& emitter) {
+  emitters_.push_back({emitter, nextEmitterId_, 0.0, 0.0});
+  return nextEmitterId_++;
+}
+
+void Simulator::removeEmitter(uint32_t id) noexcept {
+  emitters_.erase(std::remove_if(emitters_.begin(), emitters_.end(),
+                                 [id](const EmitterState& s) {
+                                   return s.id == id;
+                                 }),
+                  emitters_.end());
+}
+
+// every step an emitter owes rate * dt more particles and spawns the whole
+// ones as one batch. births are spread evenly over the step, and a particle
+// born partway through has already flown for the rest of it, so a fast
+// stream leaves as a line instead of a heap at its origin. what doesn't fit
+// under capacity is dropped rather than saved up
+void Simulator::runEmitters() {
+  RPE_PROFILE_SCOPE("emit");
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  for (EmitterState& s : emitters_) {
+    const Emitter& e = s.emitter;
+    const double start = s.time;
+    s.time += dt_;
+    s.owed += std::max(e.rate, 0.0f) * static_cast<double>(dt_);
+    // rates given as n per step come out a rounding error short of n
+    const size_t owed = static_cast<size_t>(s.owed + 1e-4);
+    s.owed -= owed;
+
+    const size_t room = capacity_ - std::min(capacity_, particles_.size());
+    const size_t n = std::min(owed, room);
+    if (n == 0) continue;
+    emitX_.resize(n);
+    emitY_.resize(n);
+    emitVx_.resize(n);
+    emitVy_.resize(n);
+    for (size_t k = 0; k < n; k++) {
+      const float born = (k + 0.5f) / owed;  // fraction of the step
+      float angle = e.angle;
+      if (e.shape == Emitter::Shape::Stream) {
+        angle += e.sweep * std::cos((start + born * dt_) * e.omega);
+      }
+      Vec2f vel(std::cos(angle) * e.speed, std::sin(angle) * e.speed);
+      if (e.jitter > 0.0f) {
+        const float jx = unit(gen_);
+        const float jy = unit(gen_);
+        vel += Vec2f(jx * 2.0f - 1.0f, jy * 2.0f - 1.0f) * e.jitter;
+      }
+
+      Vec2f pos = e.position;
+      if (e.shape == Emitter::Shape::Line) {
+        pos += (e.end - e.position) * unit(gen_);
+      } else if (e.shape == Emitter::Shape::Area) {
+        const float u = unit(gen_);
+        const float v = unit(gen_);
+        pos += Vec2f(u * e.size.x, v * e.size.y);
+      }
+      pos += vel * ((1.0f - born) * dt_);
+
+      emitX_[k] = pos.x;
+      emitY_[k] = pos.y;
+      emitVx_[k] = vel.x;
+      emitVy_[k] = vel.y;
+    }
+
+    SpawnArrays batch;
+    batch.x = emitX_.data();
+    batch.y = emitY_.data();
+    batch.vx = emitVx_.data();
+    batch.vy = emitVy_.data();
+    batch.count = n;
+    spawnParticles(batch, e.radius, e.mass);
+  }
+}
+
+uint64_t Simulator::frameHash() const noexcept {
+  uint64_t h = 14695981039346656037ull;
+  particles_.forEachArray([&](const char*, const auto& v) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(v.data());
+    const size_t n = v.size() * sizeof(v[0]);
+    for (size_t b = 0; b < n; b++) {
+      h ^= bytes[b];
+      h *= 1099511628211ull;
+    }
+  });
+  return h;
+}
+
 void Simulator::radialPush(const Vec2f& origin, const float radius,
                            const float mag, const int scale) {
+  RPE_PROFILE_SCOPE("radial push");
+  // other broad-phases never build the grid, and spawning or a reorder
+  // leaves it behind
+  if (!gridCurrent_) {
+    spatialGrid_.resize(particles_.size());
+    spatialGrid_.build(particles_.x.data(), particles_.y.data(),
+                       particles_.size(), *pool_);
+    gridCurrent_ = true;
+  }
+  // scale counts cells of the smallest size; coarser cells need fewer
+  const int reach = static_cast<int>(std::ceil(scale / gridCellFactor_));
   spatialGrid_.queryDoSomething(
       -1, origin,
       [&](int neiIdx) {
-        Particle& p = particles_[neiIdx];
-        const Vec2f d = p.position - origin;
+        const Vec2f d = particles_.position(neiIdx) - origin;
         const float d2 = d.x * d.x + d.y * d.y;
 
         if (d2 > radius * radius) return;
+        particles_.rest[neiIdx] = 0;
 
         const float invDist = 1.0f / std::sqrt(d2);
         const Vec2f norm = d * invDist;
 
-        p.accelerate({norm.x * mag, norm.y * mag});
+        particles_.accelerate(neiIdx, {norm.x * mag, norm.y * mag});
       },
-      scale);
+      reach);
 }
 
 void Simulator::update() noexcept {
-  if (integrationType_ == IntegrationType::Euler) {
-    for (Particle& par : particles_) {
-      par.accelerate({0.0f, gravity});
-      par.integrateEuler(dt_);
+  RPE_PROFILE_SCOPE("update");
+  timings_ = PhaseTimings{};
+  stats_ = BroadphaseStats{};
+  if (sleeping_ && gravity != sleepGravity_) {
+    wakeAll();
+    sleepGravity_ = gravity;
+  }
+  if (reorderInterval_ > 0) {
+    const size_t grown = particles_.size() - std::min(particles_.size(),
+                                                      sizeAtReorder_);
+    if (++framesSinceReorder_ >= reorderInterval_ ||
+        grown > std::max<size_t>(1024, sizeAtReorder_ / 8)) {
+      const auto reorderStart = Clock::now();
+      reorderParticles();
+      timings_.reorder = secondsSince(reorderStart);
     }
-  } else {
-    for (Particle& par : particles_) {
-      par.accelerate({0.0f, gravity});
-      par.integrateVerlet(dt_);
+  }
+
+  if (!emitters_.empty()) {
+    const auto emitStart = Clock::now();
+    runEmitters();
+    timings_.emit = secondsSince(emitStart);
+  }
+  if (sleeping_) supported_.assign(particles_.size(), 0);
+
+  // remember where this step starts so renderers can interpolate into it
+  const auto start = Clock::now();
+  pool_->parallelFor(0, particles_.size(), PARTICLE_GRAIN,
+                     [&](size_t begin, size_t end) {
+                       std::copy(particles_.x.begin() + begin,
+                                 particles_.x.begin() + end,
+                                 particles_.lastX.begin() + begin);
+                       std::copy(particles_.y.begin() + begin,
+                                 particles_.y.begin() + end,
+                                 particles_.lastY.begin() + begin);
+                     });
+  timings_.integrate += secondsSince(start);
+
+  for (size_t s = 0; s < substeps_; s++) substep(substepDt());
+  // only the uniform grid broad-phase keeps the grid in step with the
+  // particles; for the others radialPush has to rebuild it
+  if (broadphaseType_ != BroadphaseType::UniformGrid) gridCurrent_ = false;
+  if (sleeping_) {
+    const auto sleepStart = Clock::now();
+    updateSleep();
+    timings_.integrate += secondsSince(sleepStart);
+  }
+  steps_++;
+
+  if (recorder_) {
+    RPE_PROFILE_SCOPE("record");
+    recorder_->capture(particles_.view(), steps_, dt_);
+  }
+}
+
+size_t Simulator::advance(double elapsedSeconds) noexcept {
+  // drop time we could never catch up on instead of spiralling
+  accumulator_ = std::min(accumulator_ + std::max(elapsedSeconds, 0.0),
+                          static_cast<double>(dt_) * maxCatchUpSteps_);
+
+  size_t steps = 0;
+  while (accumulator_ >= dt_) {
+    update();
+    accumulator_ -= dt_;
+    steps++;
+  }
+  return steps;
+}
+
+void Simulator::substep(float dt) noexcept {
+  {
+    RPE_PROFILE_SCOPE("integrate");
+    const auto start = Clock::now();
+    const KernelArrays arrays{particles_.x.data(),  particles_.y.data(),
+                              particles_.prevX.data(), particles_.prevY.data(),
+                              particles_.vx.data(), particles_.vy.data(),
+                              particles_.ax.data(), particles_.ay.data(),
+                              particles_.radius.data(),
+                              particles_.rest.data()};
+    // the uniform grid and the quadtree clamp walls while they walk the
+    // cells/leaves along the border, so only the other broad-phases need
+    // them here
+    const bool broadphaseWalls =
+        (broadphaseType_ == BroadphaseType::UniformGrid &&
+         spatialGrid_.cols > 0 && spatialGrid_.rows > 0) ||
+        broadphaseType_ == BroadphaseType::Qtree;
+    const KernelParams params{dt,           gravity,     worldSize_.x,
+                              worldSize_.y, restitution, SLEEP_STEPS,
+                              !broadphaseWalls};
+
+    // gravity, integration and walls in one fused pass
+    if (integrationType_ == IntegrationType::Euler) {
+      pool_->parallelFor(0, particles_.size(), PARTICLE_GRAIN,
+                         [&](size_t begin, size_t end) {
+                           simd::integrateEuler(arrays, begin, end, params);
+                         });
+    } else {
+      pool_->parallelFor(0, particles_.size(), PARTICLE_GRAIN,
+                         [&](size_t begin, size_t end) {
+                           simd::integrateVerlet(arrays, begin, end, params);
+                         });
     }
+    timings_.integrate += secondsSince(start);
   }
   resolveCollisions();
 }
 
+// a particle that rested on something and moved less than SLEEP_SPEED radii
+// this step gets a step closer to sleeping; anything else, however slow,
+// starts over. falling asleep drops whatever velocity it had left, so it
+// wakes up at rest
+void Simulator::updateSleep() {
+  RPE_PROFILE_SCOPE("sleep");
+  ParticleStore& ps = particles_;
+  std::atomic<size_t> asleep{0};
+  pool_->parallelFor(0, ps.size(), PARTICLE_GRAIN, [&](size_t begin,
+                                                       size_t end) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+      if (ps.rest[i] >= SLEEP_STEPS) {
+        count++;
+        continue;
+      }
+      const float r = ps.radius[i];
+      const float still = SLEEP_SPEED * r;
+      const float dx = ps.x[i] - ps.lastX[i];
+      const float dy = ps.y[i] - ps.lastY[i];
+      const bool low = ps.y[i] > worldSize_.y - r - still;
+      const bool high = ps.y[i] < r + still;
+      bool supported = supported_[i];
+      if (gravity > 0.0f) {
+        supported = supported || low;
+      } else if (gravity < 0.0f) {
+        supported = supported || high;
+      } else {
+        supported = supported || low || high || ps.x[i] < r + still ||
+                    ps.x[i] > worldSize_.x - r - still;
+      }
+      if (!supported || dx * dx + dy * dy >= still * still) {
+        ps.rest[i] = 0;
+      } else if (++ps.rest[i] == SLEEP_STEPS) {
+        ps.prevX[i] = ps.x[i];
+        ps.prevY[i] = ps.y[i];
+        ps.vx[i] = 0.0f;
+        ps.vy[i] = 0.0f;
+        count++;
+      }
+    }
+    asleep += count;
+  });
+  asleep_ = asleep;
+}
+
+// particles that share a grid cell end up next to each other in memory, and
+// neighbouring cells mostly do too, so the narrow-phase stops missing cache on
+// every p2
+void Simulator::reorderParticles() {
+  RPE_PROFILE_SCOPE("reorder");
+  framesSinceReorder_ = 0;
+  sizeAtReorder_ = particles_.size();
+
+  const size_t n = particles_.size();
+  sortKeys_.resize(n);
+  sortOrder_.resize(n);
+
+  const SpatialGrid& grid = spatialGrid_;
+  const float* x = particles_.x.data();
+  const float* y = particles_.y.data();
+  pool_->parallelFor(0, n, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const int cx =
+          std::clamp(static_cast<int>(x[i] * grid.invCellSize), 0, grid.cols - 1);
+      const int cy =
+          std::clamp(static_cast<int>(y[i] * grid.invCellSize), 0, grid.rows - 1);
+      sortKeys_[i] = mortonEncode(cx, cy);
+      sortOrder_[i] = static_cast<uint32_t>(i);
+    }
+  });
+
+  radixSortPairs(sortKeys_, sortOrder_, sortTmpKeys_, sortTmpOrder_);
+  particles_.permute(sortOrder_);
+  sap_.remap(sortOrder_);
+  gridCurrent_ = false;
+}
+
 // O(n^2)
 void Simulator::naiveBroadphase() {
+  RPE_PROFILE_SCOPE("naive collide");
+  const auto start = Clock::now();
+  uint64_t contacts = 0;
   for (size_t i = 0; i < particles_.size(); i++) {
     for (size_t j = i + 1; j < particles_.size(); j++) {
-      particleCollision(particles_[i], particles_[j]);
+      contacts += particleCollision(i, j);
     }
   }
+  const uint64_t n = particles_.size();
+  stats_.candidatePairs += n > 1 ? n * (n - 1) / 2 : 0;
+  stats_.contacts += contacts;
+  timings_.narrowphase += secondsSince(start);
 }
 
-// O(nlog(n))
+// O(nlog(n)), no allocations once qtree_ and qtreeNeighbors_ have grown
 void Simulator::qtreeBroadphase(size_t bucketSize) {
-  QuadTree<Particle> qtree(AABBf({0.0f, 0.0f}, {worldSize_.x, worldSize_.y}),
-                           bucketSize);
-  for (Particle& p : particles_) {
-    qtree.insert(&p);
+  RPE_PROFILE_SCOPE("qtree collide");
+  {
+    RPE_PROFILE_SCOPE("qtree build");
+    const auto start = Clock::now();
+    qtree_.build(particles_.x.data(), particles_.y.data(), particles_.size(),
+                 AABBf({0.0f, 0.0f}, {worldSize_.x, worldSize_.y}), bucketSize);
+    timings_.build += secondsSince(start);
   }
 
-  for (size_t i = 0; i < particles_.size(); i++) {
-    Particle& p1 = particles_[i];
-    const Vec2f c1 = p1.position;
-    const float r1 = p1.radius;
-    const AABBf queryRange({c1.x - 2.0f * r1, c1.y - 2.0f * r1},
-                           {4.0f * r1, 4.0f * r1});
-
-    std::vector<Particle*> neighbors;
-    qtree.query(neighbors, queryRange);
-
-    for (Particle* nei : neighbors) {
-      Particle& p2 = *nei;
-      if (&p1 <= &p2) {
-        continue;
+  const auto narrowStart = Clock::now();
+
+  // one tree query per leaf instead of per particle: gather everything near
+  // the leaf once, then filter it against each item's own 4r query box
+  const float* rad = particles_.radius.data();
+  uint64_t candidates = 0, contacts = 0;
+  size_t leaves = 0, maxLeaf = 0;
+  qtree_.forEachLeaf([&](const QuadTree::Node& leaf, const uint32_t* items,
+                         size_t count) {
+    leaves++;
+    maxLeaf = std::max(maxLeaf, count);
+    float maxR = 0.0f;
+    for (size_t k = 0; k < count; k++) maxR = std::max(maxR, rad[items[k]]);
+    // only leaves within a radius of the world's edge can hold anything
+    // touching a wall. whatever left the world sits in an edge leaf
+    if (leaf.minX < maxR || leaf.minY < maxR ||
+        leaf.maxX > worldSize_.x - maxR || leaf.maxY > worldSize_.y - maxR) {
+      for (size_t k = 0; k < count; k++) wallCollision(items[k]);
+    }
+    const float pad = 2.0f * maxR;
+    const AABBf leafRange({leaf.minX - pad, leaf.minY - pad},
+                          {leaf.maxX - leaf.minX + 2.0f * pad,
+                           leaf.maxY - leaf.minY + 2.0f * pad});
+
+    qtreeNeighbors_.clear();
+    qtree_.query(qtreeNeighbors_, leafRange);
+
+    for (size_t k = 0; k < count; k++) {
+      const uint32_t i = items[k];
+      for (uint32_t j : qtreeNeighbors_) {
+        if (i <= j) continue;
+        const float reach = 2.0f * rad[i];
+        if (std::abs(particles_.x[j] - particles_.x[i]) > reach ||
+            std::abs(particles_.y[j] - particles_.y[i]) > reach) {
+          continue;
+        }
+        candidates++;
+        contacts += particleCollision(i, j);
       }
-      particleCollision(p1, p2);
     }
+  });
+  stats_.candidatePairs += candidates;
+  stats_.contacts += contacts;
+  stats_.maxPerCell = maxLeaf;
+  stats_.meanPerCell =
+      leaves ? static_cast<double>(particles_.size()) / leaves : 0.0;
+  stats_.treeDepth = qtree_.depth();
+  timings_.narrowphase += secondsSince(narrowStart);
+}
+
+// ~O(n + pairs) while the x order is nearly preserved between steps
+void Simulator::sweepAndPruneBroadphase() {
+  RPE_PROFILE_SCOPE("sap collide");
+  {
+    RPE_PROFILE_SCOPE("sap build");
+    const auto start = Clock::now();
+    sap_.update(particles_.x.data(), particles_.y.data(),
+                particles_.radius.data(), particles_.size());
+    timings_.build += secondsSince(start);
   }
+
+  const auto narrowStart = Clock::now();
+  uint64_t candidates = 0, contacts = 0;
+  sap_.forEachPair([&](uint32_t i, uint32_t j) {
+    candidates++;
+    contacts += particleCollision(i, j);
+  });
+  stats_.candidatePairs += candidates;
+  stats_.contacts += contacts;
+  timings_.narrowphase += secondsSince(narrowStart);
 }
 
-// O(n)
-void Simulator::spatialGridBroadphase() {
-  spatialGrid_.resize(particles_.size());
-  spatialGrid_.build(particles_);
+// O(n * levels). unlike spatialGridBroadphase this doesn't rely on
+// maxParticleRadius_, so radii can differ by orders of magnitude
+void Simulator::hierarchicalGridBroadphase() {
+  RPE_PROFILE_SCOPE("hgrid collide");
+  {
+    RPE_PROFILE_SCOPE("hgrid build");
+    const auto start = Clock::now();
+    hierGrid_.build(particles_.x.data(), particles_.y.data(),
+                    particles_.radius.data(), particles_.size(), worldSize_);
+    timings_.build += secondsSince(start);
+  }
 
-  // broad-phase
+  const auto narrowStart = Clock::now();
+  uint64_t candidates = 0, contacts = 0;
   for (size_t i = 0; i < particles_.size(); i++) {
-    Particle& p1 = particles_[i];
-    spatialGrid_.queryDoSomething(i, p1.position, [&](int neiIdx) {
-      Particle& p2 = particles_[neiIdx];
-      particleCollision(p1, p2);
+    hierGrid_.queryPairs(i, particles_.x[i], particles_.y[i], [&](int j) {
+      candidates++;
+      contacts += particleCollision(i, j);
     });
   }
+  const int occupied = hierGrid_.occupiedCells();
+  stats_.candidatePairs += candidates;
+  stats_.contacts += contacts;
+  stats_.maxPerCell = hierGrid_.maxCellCount();
+  stats_.meanPerCell =
+      occupied ? static_cast<double>(particles_.size()) / occupied : 0.0;
+  stats_.treeDepth = hierGrid_.levelCount();
+  timings_.narrowphase += secondsSince(narrowStart);
 }
 
-void Simulator::applyWall(Particle& p, float w, float h) {
-  const float r = p.radius;
+// O(n)
+void Simulator::spatialGridBroadphase() {
+  RPE_PROFILE_SCOPE("grid collide");
+  {
+    RPE_PROFILE_SCOPE("grid build");
+    const auto start = Clock::now();
+    if (adaptiveGrid_) tuneGridCellSize();
+    spatialGrid_.resize(particles_.size());
+    spatialGrid_.build(particles_.x.data(), particles_.y.data(),
+                       particles_.size(), *pool_);
+    gridCurrent_ = true;
+    timings_.build += secondsSince(start);
+  }
 
-  if (integrationType_ == IntegrationType::Euler) {
-    // top/bot
-    if (p.position.y < r) {
-      p.position.y = r;
-      p.velocity.y = -p.velocity.y * restitution;
-    } else if (p.position.y > h - r) {
-      p.position.y = h - r;
-      p.velocity.y = -p.velocity.y * restitution;
-    }
+  // broad-phase
+  const auto narrowStart = Clock::now();
+  spatialGridSolveBanded();
+  timings_.narrowphase += secondsSince(narrowStart);
+}
 
-    // left/right
-    if (p.position.x < r) {
-      p.position.x = r;
-      p.velocity.x = -p.velocity.x * restitution;
-    } else if (p.position.x > w - r) {
-      p.position.x = w - r;
-      p.velocity.x = -p.velocity.x * restitution;
+// walls are only checked for particles in the outer ring of cells: cells are
+// at least a particle across and anything past a wall is binned into the
+// nearest cell, so nothing else can reach one. the check happens as each
+// particle's cell is walked, so it needs no pass of its own.
+//
+// the grid is cut into horizontal bands of at least two rows. a particle in
+// band b only ever touches particles in rows of bands b-1..b+1, so all even
+// bands can be solved concurrently, then all odd bands. every pair is still
+// resolved exactly once per step (by its lower index). bands of one colour
+// never share a particle and each band runs in cell order, so the result is
+// the same however many threads share the bands, including one
+void Simulator::spatialGridSolveBanded() {
+  const SpatialGrid& grid = spatialGrid_;
+  const int bandRows = std::max(2, (grid.rows + SOLVE_BANDS - 1) / SOLVE_BANDS);
+  const int bands = (grid.rows + bandRows - 1) / bandRows;
+  bandStats_.resize(bands);
+
+  // pairs from a cell with no awake particle in its 3x3 block are all
+  // between sleepers, so such cells are only counted, not solved. finding
+  // those cells costs a pass over the grid, so only once enough sleep
+  const bool skipSleepers =
+      sleeping_ && asleep_ * SLEEP_SKIP_SHARE >= particles_.size();
+  if (skipSleepers) {
+    cellAwake_.resize(grid.nCells);
+    pool_->parallelFor(0, grid.nCells, PARTICLE_GRAIN, [&](size_t begin,
+                                                           size_t end) {
+      for (size_t c = begin; c < end; c++) {
+        bool awake = false;
+        grid.forEachInCell(c, [&](int i) { awake = awake || !asleep(i); });
+        cellAwake_[c] = awake;
+      }
+    });
+  }
+  auto awakeAround = [&](int cx, int cy) {
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid.rows - 1);
+         y++) {
+      for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid.cols - 1);
+           x++) {
+        if (cellAwake_[y * grid.cols + x]) return true;
+      }
     }
-  } else {
-    float vx = p.position.x - p.prevPosition.x;
-    float vy = p.position.y - p.prevPosition.y;
+    return false;
+  };
+
+  for (int colour = 0; colour < 2; colour++) {
+    const size_t tasks = (bands - colour + 1) / 2;
+    pool_->run(tasks, [&](size_t task) {
+      RPE_PROFILE_SCOPE("grid band");
+      const int band = colour + 2 * static_cast<int>(task);
+      const int rowEnd = std::min(grid.rows, (band + 1) * bandRows);
+      BandStats local{0, 0, 0, 0};
+      for (int cy = band * bandRows; cy < rowEnd; cy++) {
+        const bool borderRow = cy == 0 || cy == grid.rows - 1;
+        for (int cx = 0; cx < grid.cols; cx++) {
+          const int c = cy * grid.cols + cx;
+          if (borderRow || cx == 0 || cx == grid.cols - 1) {
+            grid.forEachInCell(c, [&](int i) { wallCollision(i); });
+          }
+          size_t inCell = 0;
+          bool quiet = false;
+          grid.forEachInCell(c, [&](int i) {
+            if (inCell++ == 0 && skipSleepers) quiet = !awakeAround(cx, cy);
+            if (quiet) return;
+            const bool sleeper = sleeping_ && asleep(i);
+            grid.queryCell(i, cx, cy, [&](int neiIdx) {
+              if (sleeper && asleep(neiIdx)) return;
+              local.candidatePairs++;
+              local.contacts += particleCollision(i, neiIdx);
+            });
+          });
+          if (inCell > 0) local.occupiedCells++;
+          local.maxPerCell = std::max(local.maxPerCell, inCell);
+        }
+      }
+      bandStats_[band] = local;
+    });
+  }
 
-    // top/bot
-    if (p.position.y < r) {
-      p.position.y = r;
-      p.prevPosition.y = p.position.y + vy * restitution;
-    } else if (p.position.y > h - r) {
-      p.position.y = h - r;
-      p.prevPosition.y = p.position.y + vy * restitution;
-    }
+  size_t occupied = 0;
+  uint64_t candidates = 0, contacts = 0;
+  stats_.maxPerCell = 0;
+  for (const BandStats& b : bandStats_) {
+    candidates += b.candidatePairs;
+    contacts += b.contacts;
+    stats_.maxPerCell = std::max(stats_.maxPerCell, b.maxPerCell);
+    occupied += b.occupiedCells;
+  }
+  stats_.candidatePairs += candidates;
+  stats_.contacts += contacts;
+  stats_.meanPerCell =
+      occupied ? static_cast<double>(particles_.size()) / occupied : 0.0;
+  stats_.cellSize = grid.cellSize;
+
+  gridTuneSolves_++;
+  gridTuneCells_ += static_cast<uint64_t>(grid.nCells);
+  gridTuneMisses_ += candidates - contacts;
+}
 
-    // left/right
-    if (p.position.x < r) {
-      p.position.x = r;
-      p.prevPosition.x = p.position.x + vx * restitution;
-    } else if (p.position.x > w - r) {
-      p.position.x = w - r;
-      p.prevPosition.x = p.position.x + vx * restitution;
-    }
+// every step pays per cell (resetting heads or prefix summing counts, then
+// the solve walking every cell) and per pair that shares a 3x3 block without
+// touching. scaling the cell size by s divides the first by s^2 and, wherever
+// particles are packed, multiplies the second by about s^2, so the cheapest
+// scale is s^2 = sqrt(cellCost / pairCost). decisions only look at counts,
+// never timings, so every machine and thread count picks the same cells
+void Simulator::tuneGridCellSize() {
+  if (gridTuneSolves_ < GRID_TUNE_SOLVES) return;
+  const double cellCost = GRID_CELL_COST * gridTuneCells_;
+  const double pairCost = GRID_PAIR_COST * gridTuneMisses_;
+  gridTuneSolves_ = 0;
+  gridTuneCells_ = 0;
+  gridTuneMisses_ = 0;
+
+  // at least one cell across the world
+  const float minWorld = std::min(worldSize_.x, worldSize_.y);
+  const float maxFactor = std::clamp(minWorld / (2.0f * maxParticleRadius_),
+                                     1.0f, GRID_MAX_CELL_FACTOR);
+
+  // factors move in steps of sqrt(2) so noise near a boundary stays put
+  float factor = maxFactor;
+  if (pairCost > 0.0) {
+    const double s2 = std::sqrt(cellCost / pairCost);
+    const double k2 = gridCellFactor_ * gridCellFactor_ * s2;
+    factor = static_cast<float>(std::exp2(std::round(std::log2(k2)) * 0.5));
+    factor = std::clamp(factor, 1.0f, maxFactor);
   }
+  if (factor == gridCellFactor_) return;
+
+  const double ratio = (factor / gridCellFactor_) * (factor / gridCellFactor_);
+  const double predicted = cellCost / ratio + pairCost * ratio;
+  if (predicted > GRID_RETUNE_GAIN * (cellCost + pairCost)) return;
+
+  gridCellFactor_ = factor;
+  configureGrid();
 }
 
-void Simulator::particleCollision(Particle& p1, Particle& p2) {
-  const Vec2f d = p2.position - p1.position;
+bool Simulator::particleCollision(size_t i, size_t j) {
+  ParticleStore& ps = particles_;
+  if (sleeping_ && asleep(i) && asleep(j)) return false;
+  const Vec2f d = ps.position(j) - ps.position(i);
   const float d2 = d.x * d.x + d.y * d.y;
-  const float sum_r = p1.radius + p2.radius;
+  const float sum_r = ps.radius[i] + ps.radius[j];
   const float sum_r2 = sum_r * sum_r;
 
   // square dist prune
-  if (d2 >= sum_r2) return;
+  if (d2 >= sum_r2) return false;
+
+  float invMass1 = ps.invMass[i];
+  float invMass2 = ps.invMass[j];
+  if (sleeping_) {
+    // a sleeper only wakes for a partner that moved WAKE_SPEED radii this
+    // step. anything slower leans on it as if it were fixed
+    auto moving = [&](size_t k) {
+      const float mx = ps.x[k] - ps.lastX[k];
+      const float my = ps.y[k] - ps.lastY[k];
+      const float wake = WAKE_SPEED * ps.radius[k];
+      return mx * mx + my * my > wake * wake;
+    };
+    if (asleep(i)) {
+      if (moving(j)) {
+        ps.rest[i] = 0;
+      } else {
+        invMass1 = 0.0f;
+        supported_[j] = 1;
+      }
+    } else if (asleep(j)) {
+      if (moving(i)) {
+        ps.rest[j] = 0;
+      } else {
+        invMass2 = 0.0f;
+        supported_[i] = 1;
+      }
+    } else {
+      // resting on a particle that is itself on its way to sleep
+      if (ps.rest[j] > 0 || gravity == 0.0f) supported_[i] = 1;
+      if (ps.rest[i] > 0 || gravity == 0.0f) supported_[j] = 1;
+    }
+  }
+  const float invMassSum = invMass1 + invMass2;
 
   // if small dist apart
   if (d2 < 1e-12f) {
-    Vec2f n = {1.0f, 0.0f};
-    const float half = (p1.radius + p2.radius) * 0.5f;
+    const float half = sum_r * 0.5f;
 
-    const float invMassSum = p1.invMass + p2.invMass;
     if (invMassSum > 0.0f) {
-      p1.prevPosition = p1.position;
-      p2.prevPosition = p2.position;
-      p1.position -= n * (half * (p1.invMass / invMassSum));
-      p2.position += n * (half * (p2.invMass / invMassSum));
+      ps.prevX[i] = ps.x[i];
+      ps.prevY[i] = ps.y[i];
+      ps.prevX[j] = ps.x[j];
+      ps.prevY[j] = ps.y[j];
+      // push apart along {1, 0}
+      ps.x[i] -= half * (invMass1 / invMassSum);
+      ps.x[j] += half * (invMass2 / invMassSum);
     }
-    return;
+    return true;
   }
 
   const float invDist = 1.0f / std::sqrt(d2);
@@ -194,33 +916,35 @@ void Simulator::particleCollision(Particle& p1, Particle& p2) {
   const Vec2f norm = d * invDist;
   const float penetration = sum_r - dist;
 
-  const float invMassSum = p1.invMass + p2.invMass;
-
   if (penetration > 0.0f && invMassSum > 0.0f) {
     float percent = 0.30f;
     const Vec2f correction = norm * (percent * penetration / invMassSum);
-    p1.position -= correction * p1.invMass;
-    p2.position += correction * p2.invMass;
+    ps.x[i] -= correction.x * invMass1;
+    ps.y[i] -= correction.y * invMass1;
+    ps.x[j] += correction.x * invMass2;
+    ps.y[j] += correction.y * invMass2;
   }
 
   if (integrationType_ == IntegrationType::Euler) {
-    const Vec2f relV = (p2.velocity - p1.velocity);
+    const Vec2f relV(ps.vx[j] - ps.vx[i], ps.vy[j] - ps.vy[i]);
     const float relVel = relV.x * norm.x + relV.y * norm.y;
     if (relVel < 0) {
       const float magJ = (1.0f + restitution) * relVel / invMassSum;
       const Vec2f J = norm * magJ;
-      p1.velocity += J * p1.invMass;
-      p2.velocity -= J * p2.invMass;
+      ps.vx[i] += J.x * invMass1;
+      ps.vy[i] += J.y * invMass1;
+      ps.vx[j] -= J.x * invMass2;
+      ps.vy[j] -= J.y * invMass2;
     }
   } else {
-    Vec2f v1 = p1.position - p1.prevPosition;
-    Vec2f v2 = p2.position - p2.prevPosition;
+    Vec2f v1 = ps.position(i) - Vec2f(ps.prevX[i], ps.prevY[i]);
+    Vec2f v2 = ps.position(j) - Vec2f(ps.prevX[j], ps.prevY[j]);
     const Vec2f relV = v2 - v1;
 
     const float relVelN = relV.x * norm.x + relV.y * norm.y;
     if (relVelN < 0) {
-      const float w1 = p1.invMass / invMassSum;
-      const float w2 = p2.invMass / invMassSum;
+      const float w1 = invMass1 / invMassSum;
+      const float w2 = invMass2 / invMassSum;
 
       const float nRelVelN = -restitution * relVelN;
       const float dRelVelN = nRelVelN - relVelN;
@@ -229,28 +953,60 @@ void Simulator::particleCollision(Particle& p1, Particle& p2) {
       v1 -= dV * w1;
       v2 += dV * w2;
 
-      p1.prevPosition = p1.position - v1;
-      p2.prevPosition = p2.position - v2;
+      ps.prevX[i] = ps.x[i] - v1.x;
+      ps.prevY[i] = ps.y[i] - v1.y;
+      ps.prevX[j] = ps.x[j] - v2.x;
+      ps.prevY[j] = ps.y[j] - v2.y;
+    }
+  }
+  return true;
+}
+
+// the integrate kernels' wall response, for broad-phases that only visit the
+// particles along the walls. verlet prev still holds the position before this
+// sub-step's integration, so x - prev is the step the kernel would reflect
+void Simulator::wallCollision(size_t i) noexcept {
+  if (asleep(i)) return;
+  ParticleStore& ps = particles_;
+  const float r = ps.radius[i];
+  const float hr = worldSize_.y - r;
+  const float wr = worldSize_.x - r;
+
+  if (integrationType_ == IntegrationType::Verlet) {
+    const float vx = ps.x[i] - ps.prevX[i];
+    const float vy = ps.y[i] - ps.prevY[i];
+    // top/bot
+    if (ps.y[i] < r || ps.y[i] > hr) {
+      ps.y[i] = ps.y[i] < r ? r : hr;
+      ps.prevY[i] = ps.y[i] + vy * restitution;
+    }
+    // left/right
+    if (ps.x[i] < r || ps.x[i] > wr) {
+      ps.x[i] = ps.x[i] < r ? r : wr;
+      ps.prevX[i] = ps.x[i] + vx * restitution;
+    }
+  } else {
+    if (ps.y[i] < r || ps.y[i] > hr) {
+      ps.y[i] = ps.y[i] < r ? r : hr;
+      ps.vy[i] = -ps.vy[i] * restitution;
+    }
+    if (ps.x[i] < r || ps.x[i] > wr) {
+      ps.x[i] = ps.x[i] < r ? r : wr;
+      ps.vx[i] = -ps.vx[i] * restitution;
     }
   }
 }
 
 void Simulator::resolveCollisions() {
-  auto [w, h] = worldSize_;
   if (broadphaseType_ == BroadphaseType::UniformGrid) {
-    for (Particle& par : particles_) {
-      applyWall(par, w, h);
-    }
     spatialGridBroadphase();
   } else if (broadphaseType_ == BroadphaseType::Qtree) {
-    for (Particle& par : particles_) {
-      applyWall(par, w, h);
-    }
     qtreeBroadphase(16);
+  } else if (broadphaseType_ == BroadphaseType::HierarchicalGrid) {
+    hierarchicalGridBroadphase();
+  } else if (broadphaseType_ == BroadphaseType::SweepAndPrune) {
+    sweepAndPruneBroadphase();
   } else {
-    for (Particle& par : particles_) {
-      applyWall(par, w, h);
-    }
     naiveBroadphase();
   }
 }
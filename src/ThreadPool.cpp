@@ -0,0 +1,109 @@
+#include <Profiler.hpp>
+#include <ThreadPool.hpp>
+
+ThreadPool::ThreadPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  queues_.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+
+  workers_.reserve(threads - 1);
+  for (size_t i = 1; i < threads; i++) {
+    workers_.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& t : workers_) {
+    t.join();
+  }
+}
+
+void ThreadPool::dispatch(size_t begin, size_t end, size_t grain, void* ctx,
+                          Thunk fn) {
+  const size_t chunks = (end - begin + grain - 1) / grain;
+  const size_t nQueues = queues_.size();
+
+  // deal out contiguous runs of chunks so each worker starts on its own slice
+  // of memory. queues are only touched here while every worker is idle
+  for (size_t q = 0; q < nQueues; q++) {
+    Queue& queue = *queues_[q];
+    const size_t first = chunks * q / nQueues;
+    const size_t last = chunks * (q + 1) / nQueues;
+    queue.items.clear();
+    for (size_t c = first; c < last; c++) {
+      const size_t b = begin + c * grain;
+      queue.items.push_back({b, std::min(end, b + grain)});
+    }
+    queue.head = 0;
+    queue.tail = queue.items.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobCtx_ = ctx;
+    jobFn_ = fn;
+    busyWorkers_ = workers_.size();
+    generation_++;
+  }
+  wake_.notify_all();
+
+  drain(0);
+
+  // the job (and the queues) are only released once every worker has left it
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return busyWorkers_ == 0; });
+  jobCtx_ = nullptr;
+  jobFn_ = nullptr;
+}
+
+bool ThreadPool::popOwn(size_t self, Range& out) {
+  Queue& q = *queues_[self];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.head == q.tail) return false;
+  out = q.items[q.head++];
+  return true;
+}
+
+bool ThreadPool::steal(size_t self, Range& out) {
+  const size_t nQueues = queues_.size();
+  for (size_t k = 1; k < nQueues; k++) {
+    Queue& q = *queues_[(self + k) % nQueues];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.head == q.tail) continue;
+    out = q.items[--q.tail];
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::drain(size_t self) {
+  Range r;
+  while (popOwn(self, r) || steal(self, r)) {
+    jobFn_(jobCtx_, r.begin, r.end);
+  }
+}
+
+void ThreadPool::workerLoop(size_t self) {
+  Profiler::setThreadName("pool worker", false);
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_) return;
+      seen = generation_;
+    }
+
+    drain(self);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busyWorkers_ == 0) done_.notify_one();
+  }
+}
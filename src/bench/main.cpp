@@ -0,0 +1,651 @@
+#include <Profiler.hpp>
+#include <Simulator.hpp>
+#include <io/Snapshot.hpp>
+#include <io/Trajectory.hpp>
+#include <simd/Kernels.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Headless benchmark driver. Runs named, seeded scenarios against the
+// Simulator only (no SFML) and prints a JSON report to stdout or --out.
+
+static constexpr float PI_F = 3.14159265f;
+
+struct BenchConfig {
+  std::vector<std::string> scenarios;
+  size_t particles = 100000;
+  size_t steps = 600;
+  size_t warmup = 60;
+  uint32_t seed = 1337;
+  size_t threads = 1;
+  size_t reorder = 30;
+  size_t substeps = 1;
+  Vec2f world = {1920.0f, 1080.0f};
+  float radius = 2.0f;
+  float dt = 1.0f / 60.0f;
+  IntegrationType integration = IntegrationType::Verlet;
+  BroadphaseType broadphase = BroadphaseType::UniformGrid;
+  GridLayout gridLayout = GridLayout::LinkedList;
+  bool adaptiveGrid = false;
+  bool sleeping = false;
+  std::string out;
+  std::string load;  // start every scenario from this snapshot
+  std::string save;  // snapshot each scenario's final state here
+  std::string record;  // trajectory of each scenario's measured steps
+  bool verify = false;  // compare every step against a 1-thread run
+  std::string trace;    // Chrome trace of the last profiled scopes
+};
+
+struct Scenario {
+  const char* name;
+  const char* description;
+  float gravity;
+  float restitution;
+  // called once before warmup
+  void (*setup)(Simulator& sim, const BenchConfig& cfg, std::mt19937& gen);
+  // called before every step, with the global step index
+  void (*drive)(Simulator& sim, const BenchConfig& cfg, std::mt19937& gen,
+                size_t step);
+};
+
+struct ScenarioResult {
+  const Scenario* scenario;
+  size_t particles;
+  double setupSeconds;  // spawning, or loading the snapshot
+  double totalSeconds;
+  std::vector<double> stepSeconds;
+  PhaseTimings phaseTotals;
+  // pair counts and meanPerCell summed over steps, cellSize from the last
+  // step, the rest the worst step
+  BroadphaseStats broadphaseTotals;
+  size_t asleep;  // at the end
+  uint64_t framesRecorded;
+  uint64_t framesDropped;
+  uint64_t finalHash;
+  std::vector<uint64_t> stepHashes;  // only with --verify
+  size_t firstMismatch;              // SIZE_MAX if the runs agree
+};
+
+// --- scenarios ---
+
+// mirrors Renderer::spawnMax: fill to capacity at random positions
+static void fillRandom(Simulator& sim, const BenchConfig& cfg, std::mt19937&) {
+  SpawnPattern pattern;
+  pattern.shape = SpawnPattern::Shape::Random;
+  pattern.size = {cfg.world.x - 20.0f, cfg.world.y - 20.0f};
+  sim.spawnParticles(pattern, sim.capacity(), cfg.radius, 1.0f);
+}
+
+// like fillRandom, but radii span radius..25 * radius with most particles
+// near the small end, for the hierarchical grid
+static void fillMixed(Simulator& sim, const BenchConfig& cfg,
+                      std::mt19937& gen) {
+  std::uniform_real_distribution<float> distX(0.0f, cfg.world.x - 20.0f);
+  std::uniform_real_distribution<float> distY(0.0f, cfg.world.y - 20.0f);
+  std::uniform_real_distribution<float> distT(0.0f, 1.0f);
+  std::vector<float> xs(sim.capacity()), ys(xs.size()), rs(xs.size());
+  for (size_t i = 0; i < xs.size(); i++) {
+    const float t = distT(gen);
+    rs[i] = cfg.radius * (1.0f + 24.0f * t * t * t * t * t * t);
+    xs[i] = distX(gen);
+    ys[i] = distY(gen);
+  }
+  SpawnArrays batch;
+  batch.x = xs.data();
+  batch.y = ys.data();
+  batch.radius = rs.data();
+  batch.count = xs.size();
+  sim.spawnParticles(batch, cfg.radius, 1.0f);
+}
+
+static void noDrive(Simulator&, const BenchConfig&, std::mt19937&, size_t) {}
+
+static void noSetup(Simulator&, const BenchConfig&, std::mt19937&) {}
+
+// the app's Space toggle: an oscillating stream at 8 particles per step. the
+// emitter is added on the first step rather than in setup, so it also runs
+// from a --load snapshot
+static void driveStream(Simulator& sim, const BenchConfig& cfg, std::mt19937&,
+                        size_t step) {
+  if (step > 0) return;
+  Emitter stream;
+  stream.shape = Emitter::Shape::Stream;
+  stream.position = {cfg.world.x * 0.5f, 25.0f};
+  stream.rate = 8.0f / cfg.dt;
+  stream.speed = 1200.0f;
+  stream.angle = 0.5f * PI_F;
+  stream.sweep = 0.5f * PI_F;
+  stream.omega = 0.5f;
+  stream.radius = cfg.radius;
+  sim.addEmitter(stream);
+}
+
+// a line emitter across the top raining 100 particles per step
+static void driveRain(Simulator& sim, const BenchConfig& cfg, std::mt19937&,
+                      size_t step) {
+  if (step > 0) return;
+  Emitter rain;
+  rain.shape = Emitter::Shape::Line;
+  rain.position = {cfg.radius, cfg.radius};
+  rain.end = {cfg.world.x - cfg.radius, cfg.radius};
+  rain.rate = 100.0f / cfg.dt;
+  rain.speed = 200.0f;
+  rain.angle = 0.5f * PI_F;
+  rain.radius = cfg.radius;
+  sim.addEmitter(rain);
+}
+
+// several pushers orbiting the world center, like holding down left click
+static void drivePush(Simulator& sim, const BenchConfig& cfg, std::mt19937&,
+                      size_t step) {
+  const int scale = 10;
+  const float pushRadius = 2.0f * cfg.radius * scale;
+  const size_t pushers = 4;
+  const float t = step * cfg.dt;
+  for (size_t k = 0; k < pushers; k++) {
+    const float phase = 2.0f * PI_F * k / pushers + t;
+    const Vec2f origin(
+        cfg.world.x * (0.5f + 0.35f * std::cos(phase)),
+        cfg.world.y * (0.5f + 0.35f * std::sin(phase * 1.3f)));
+    sim.radialPush(origin, pushRadius, 2000.0f, scale);
+  }
+}
+
+static const Scenario SCENARIOS[] = {
+    {"fill", "capacity spawned at random positions, no gravity", 0.0f, 0.5f,
+     fillRandom, noDrive},
+    {"stream", "oscillating stream from the top center under gravity", 100.0f,
+     0.5f, noSetup, driveStream},
+    {"rain", "line emitter across the top at 100 per step under gravity",
+     100.0f, 0.5f, noSetup, driveRain},
+    {"pileup", "capacity spawned at random positions settling under gravity",
+     100.0f, 0.2f, fillRandom, noDrive},
+    {"push", "capacity spawned with four radial pushers orbiting the center",
+     0.0f, 0.5f, fillRandom, drivePush},
+    {"mixed", "capacity spawned with radii from 1x to 25x, settling under gravity",
+     100.0f, 0.2f, fillMixed, noDrive},
+};
+
+static const Scenario* findScenario(const std::string& name) {
+  for (const Scenario& s : SCENARIOS) {
+    if (name == s.name) return &s;
+  }
+  return nullptr;
+}
+
+// --- running ---
+
+static ScenarioResult runScenario(const Scenario& sc, const BenchConfig& cfg) {
+  Simulator sim(cfg.world, cfg.radius, sc.gravity, sc.restitution, cfg.dt,
+                cfg.integration, cfg.broadphase, cfg.particles, cfg.threads);
+  sim.seed(cfg.seed);
+  sim.setGridLayout(cfg.gridLayout);
+  sim.setAdaptiveGrid(cfg.adaptiveGrid);
+  sim.setSleeping(cfg.sleeping);
+  sim.setReorderInterval(cfg.reorder);
+  sim.setSubsteps(cfg.substeps);
+  std::mt19937 gen(cfg.seed);
+
+  const auto setupStart = std::chrono::steady_clock::now();
+  if (cfg.load.empty()) {
+    sc.setup(sim, cfg, gen);
+  } else {
+    // particles, world and radius come from the file; everything the bench
+    // was asked to measure is applied on top
+    Snapshot::load(sim, cfg.load);
+    sim.gravity = sc.gravity;
+    sim.restitution = sc.restitution;
+    sim.setDeltaTime(cfg.dt);
+    sim.setSubsteps(cfg.substeps);
+    sim.setIntegrationType(cfg.integration);
+    sim.setBroadphaseType(cfg.broadphase);
+  }
+  const double setupSeconds = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - setupStart)
+                                  .count();
+
+  size_t step = 0;
+  for (; step < cfg.warmup; step++) {
+    sc.drive(sim, cfg, gen, step);
+    sim.update();
+  }
+
+  ScenarioResult res{&sc, 0, setupSeconds, 0.0, {}, {}, {}, 0, 0, 0, 0, {},
+                     SIZE_MAX};
+  res.stepSeconds.reserve(cfg.steps);
+
+  // recording is part of what gets measured: capture() runs inside update()
+  std::unique_ptr<TrajectoryRecorder> recorder;
+  if (!cfg.record.empty()) {
+    recorder = std::make_unique<TrajectoryRecorder>(cfg.record);
+    sim.setRecorder(recorder.get());
+  }
+
+  for (size_t i = 0; i < cfg.steps; i++, step++) {
+    sc.drive(sim, cfg, gen, step);
+
+    const auto start = std::chrono::steady_clock::now();
+    sim.update();
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    res.stepSeconds.push_back(elapsed);
+    res.totalSeconds += elapsed;
+
+    const PhaseTimings& t = sim.timings();
+    res.phaseTotals.integrate += t.integrate;
+    res.phaseTotals.build += t.build;
+    res.phaseTotals.narrowphase += t.narrowphase;
+    res.phaseTotals.reorder += t.reorder;
+    res.phaseTotals.emit += t.emit;
+
+    const BroadphaseStats& b = sim.broadphaseStats();
+    BroadphaseStats& bt = res.broadphaseTotals;
+    bt.candidatePairs += b.candidatePairs;
+    bt.contacts += b.contacts;
+    bt.maxPerCell = std::max(bt.maxPerCell, b.maxPerCell);
+    bt.meanPerCell += b.meanPerCell;
+    bt.treeDepth = std::max(bt.treeDepth, b.treeDepth);
+    bt.cellSize = b.cellSize;
+
+    // hashing stays outside the timed region
+    if (cfg.verify) res.stepHashes.push_back(sim.frameHash());
+  }
+  res.finalHash = sim.frameHash();
+  res.particles = sim.particles().size();
+  res.asleep = sim.sleepingCount();
+  if (recorder) {
+    sim.setRecorder(nullptr);
+    recorder->close();
+    res.framesRecorded = recorder->framesWritten();
+    res.framesDropped = recorder->framesDropped();
+  }
+  if (!cfg.save.empty()) Snapshot::save(sim, cfg.save);
+  return res;
+}
+
+// reruns sc on one thread and records the first step whose state differs.
+// the reference writes no files
+static void verifyScenario(const Scenario& sc, const BenchConfig& cfg,
+                           ScenarioResult& res) {
+  BenchConfig refCfg = cfg;
+  refCfg.threads = 1;
+  refCfg.save.clear();
+  refCfg.record.clear();
+  const ScenarioResult ref = runScenario(sc, refCfg);
+
+  const size_t steps = std::min(ref.stepHashes.size(), res.stepHashes.size());
+  for (size_t i = 0; i < steps; i++) {
+    if (ref.stepHashes[i] != res.stepHashes[i]) {
+      res.firstMismatch = i;
+      return;
+    }
+  }
+  if (ref.stepHashes.size() != res.stepHashes.size()) {
+    res.firstMismatch = steps;
+  }
+}
+
+static double percentile(const std::vector<double>& sorted, double q) {
+  if (sorted.empty()) return 0.0;
+  const size_t idx = std::min(
+      sorted.size() - 1, static_cast<size_t>(std::ceil(q * sorted.size())) - 1);
+  return sorted[idx];
+}
+
+// --- reporting ---
+
+static const char* integrationName(IntegrationType t) {
+  return t == IntegrationType::Euler ? "euler" : "verlet";
+}
+
+static const char* broadphaseName(BroadphaseType t) {
+  switch (t) {
+    case BroadphaseType::Naive:
+      return "naive";
+    case BroadphaseType::Qtree:
+      return "qtree";
+    case BroadphaseType::UniformGrid:
+      return "grid";
+    case BroadphaseType::SweepAndPrune:
+      return "sap";
+    case BroadphaseType::HierarchicalGrid:
+      return "hgrid";
+  }
+  return "unknown";
+}
+
+static void writeJson(std::ostream& os, const BenchConfig& cfg,
+                      const std::vector<ScenarioResult>& results) {
+  os << "{\n";
+  os << "  \"benchmark\": \"RPEngineBench\",\n";
+  os << "  \"config\": {\n";
+  os << "    \"particles\": " << cfg.particles << ",\n";
+  os << "    \"steps\": " << cfg.steps << ",\n";
+  os << "    \"warmup\": " << cfg.warmup << ",\n";
+  os << "    \"seed\": " << cfg.seed << ",\n";
+  os << "    \"threads\": " << cfg.threads << ",\n";
+  os << "    \"reorder_interval\": " << cfg.reorder << ",\n";
+  os << "    \"substeps\": " << cfg.substeps << ",\n";
+  if (!cfg.load.empty()) {
+    os << "    \"snapshot\": \"" << cfg.load << "\",\n";
+  }
+  if (!cfg.record.empty()) {
+    os << "    \"record\": \"" << cfg.record << "\",\n";
+  }
+  os << "    \"verify\": " << (cfg.verify ? "true" : "false") << ",\n";
+  os << "    \"simd\": \"" << simd::name(simd::level()) << "\",\n";
+  os << "    \"world\": [" << cfg.world.x << ", " << cfg.world.y << "],\n";
+  os << "    \"radius\": " << cfg.radius << ",\n";
+  os << "    \"dt\": " << cfg.dt << ",\n";
+  os << "    \"integration\": \"" << integrationName(cfg.integration)
+     << "\",\n";
+  os << "    \"broadphase\": \"" << broadphaseName(cfg.broadphase) << "\",\n";
+  os << "    \"grid\": \""
+     << (cfg.gridLayout == GridLayout::CountingSort ? "sorted" : "list")
+     << "\",\n";
+  os << "    \"adaptive_grid\": " << (cfg.adaptiveGrid ? "true" : "false")
+     << ",\n";
+  os << "    \"sleeping\": " << (cfg.sleeping ? "true" : "false") << "\n";
+  os << "  },\n";
+  os << "  \"scenarios\": [";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const ScenarioResult& r = results[i];
+    const double steps = static_cast<double>(r.stepSeconds.size());
+    std::vector<double> sorted = r.stepSeconds;
+    std::sort(sorted.begin(), sorted.end());
+
+    const double meanMs = steps > 0 ? 1e3 * r.totalSeconds / steps : 0.0;
+    const double p50Ms = 1e3 * percentile(sorted, 0.50);
+    const double p99Ms = 1e3 * percentile(sorted, 0.99);
+    const double maxMs = sorted.empty() ? 0.0 : 1e3 * sorted.back();
+    const double stepsPerSec =
+        r.totalSeconds > 0.0 ? steps / r.totalSeconds : 0.0;
+
+    const PhaseTimings& p = r.phaseTotals;
+    const double phaseSum =
+        p.integrate + p.build + p.narrowphase + p.reorder + p.emit;
+    auto phase = [&](const char* name, double total, bool last) {
+      os << "        \"" << name << "\": {\"ms\": "
+         << (steps > 0 ? 1e3 * total / steps : 0.0) << ", \"share\": "
+         << (phaseSum > 0.0 ? total / phaseSum : 0.0) << "}"
+         << (last ? "\n" : ",\n");
+    };
+
+    os << (i ? ",\n" : "\n");
+    os << "    {\n";
+    os << "      \"name\": \"" << r.scenario->name << "\",\n";
+    os << "      \"description\": \"" << r.scenario->description << "\",\n";
+    os << "      \"particles\": " << r.particles << ",\n";
+    os << "      \"setup_ms\": " << 1e3 * r.setupSeconds << ",\n";
+    if (cfg.sleeping) os << "      \"asleep\": " << r.asleep << ",\n";
+    os << "      \"steps_per_sec\": " << stepsPerSec << ",\n";
+    os << "      \"step_ms\": {\"mean\": " << meanMs << ", \"p50\": " << p50Ms
+       << ", \"p99\": " << p99Ms << ", \"max\": " << maxMs << "},\n";
+    os << "      \"meets_60fps\": " << (p99Ms <= 1e3 / 60.0 ? "true" : "false")
+       << ",\n";
+    char hash[19];
+    std::snprintf(hash, sizeof(hash), "0x%016llx",
+                  static_cast<unsigned long long>(r.finalHash));
+    os << "      \"final_hash\": \"" << hash << "\",\n";
+    if (cfg.verify) {
+      os << "      \"deterministic\": "
+         << (r.firstMismatch == SIZE_MAX ? "true" : "false");
+      if (r.firstMismatch != SIZE_MAX) {
+        os << ", \"first_mismatch_step\": " << r.firstMismatch;
+      }
+      os << ",\n";
+    }
+    if (!cfg.record.empty()) {
+      os << "      \"recorded_frames\": " << r.framesRecorded
+         << ", \"dropped_frames\": " << r.framesDropped << ",\n";
+    }
+    const BroadphaseStats& b = r.broadphaseTotals;
+    const double perStep = steps > 0 ? 1.0 / steps : 0.0;
+    os << "      \"broadphase\": {\"candidate_pairs\": "
+       << perStep * static_cast<double>(b.candidatePairs)
+       << ", \"contacts\": " << perStep * static_cast<double>(b.contacts)
+       << ", \"hit_rate\": "
+       << (b.candidatePairs ? static_cast<double>(b.contacts) /
+                                  static_cast<double>(b.candidatePairs)
+                            : 0.0)
+       << ",\n        \"max_per_cell\": " << b.maxPerCell
+       << ", \"mean_per_cell\": " << perStep * b.meanPerCell
+       << ", \"tree_depth\": " << b.treeDepth
+       << ", \"cell_size\": " << b.cellSize << "},\n";
+    os << "      \"phases\": {\n";
+    phase("integrate", p.integrate, false);
+    phase("build", p.build, false);
+    phase("narrowphase", p.narrowphase, false);
+    phase("reorder", p.reorder, false);
+    phase("emit", p.emit, true);
+    os << "      }\n";
+    os << "    }";
+  }
+  os << "\n  ]\n}\n";
+}
+
+// --- cli ---
+
+static void usage(std::ostream& os, const char* argv0) {
+  os
+      << "usage: " << argv0 << " [options]\n"
+      << "  --scenario NAME    run NAME (repeatable, default: all)\n"
+      << "  --particles N      particle capacity (default 100000)\n"
+      << "  --steps N          measured steps per scenario (default 600)\n"
+      << "  --warmup N         unmeasured steps before timing (default 60)\n"
+      << "  --seed N           RNG seed (default 1337)\n"
+      << "  --threads N        simulator worker threads (default 1)\n"
+      << "  --simd LEVEL       avx2 | sse2 | scalar (default: best available)\n"
+      << "  --world WxH        world size in pixels (default 1920x1080)\n"
+      << "  --radius R         particle radius (default 2)\n"
+      << "  --integration T    verlet | euler\n"
+      << "  --broadphase T     grid | hgrid | qtree | sap | naive\n"
+      << "  --grid LAYOUT      list | sorted (uniform grid cell layout)\n"
+      << "  --adaptive-grid    let the uniform grid re-pick its cell size\n"
+      << "  --sleep            let settled particles sleep\n"
+      << "  --reorder N        Z-order re-sort every N steps, 0 = off (default 30)\n"
+      << "  --substeps N       integrate + collide passes per step (default 1)\n"
+      << "  --out FILE         write JSON to FILE instead of stdout\n"
+      << "  --load FILE        start scenarios from a snapshot instead of setup\n"
+      << "  --save FILE        snapshot the final state of each scenario\n"
+      << "  --record FILE      record each scenario's measured steps to a\n"
+      << "                     trajectory (time includes capture)\n"
+      << "  --verify           rerun each scenario on one thread and check\n"
+      << "                     every step hashes the same\n"
+      << "  --trace FILE       write recent profiler scopes as Chrome trace\n"
+      << "                     JSON (needs -DRPENGINE_PROFILE=ON)\n"
+      << "  --list             list scenarios and exit\n"
+      << "  -h, --help         show this help and exit\n";
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& cfg) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    auto value = [&]() -> const char* {
+      if (i + 1 >= argc) {
+        std::cerr << "missing value for " << arg << "\n";
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--scenario") {
+      cfg.scenarios.emplace_back(value());
+    } else if (arg == "--particles") {
+      cfg.particles = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--steps") {
+      cfg.steps = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--warmup") {
+      cfg.warmup = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--seed") {
+      cfg.seed = static_cast<uint32_t>(std::strtoul(value(), nullptr, 10));
+    } else if (arg == "--threads") {
+      cfg.threads = std::max<size_t>(1, std::strtoull(value(), nullptr, 10));
+    } else if (arg == "--simd") {
+      const std::string v = value();
+      if (v == "avx2") {
+        simd::setLevel(SimdLevel::AVX2);
+      } else if (v == "sse2") {
+        simd::setLevel(SimdLevel::SSE2);
+      } else if (v == "scalar") {
+        simd::setLevel(SimdLevel::Scalar);
+      } else {
+        std::cerr << "unknown simd level: " << v << "\n";
+        return false;
+      }
+    } else if (arg == "--reorder") {
+      cfg.reorder = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--substeps") {
+      cfg.substeps = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--world") {
+      if (std::sscanf(value(), "%fx%f", &cfg.world.x, &cfg.world.y) != 2) {
+        std::cerr << "--world expects WxH\n";
+        return false;
+      }
+    } else if (arg == "--radius") {
+      cfg.radius = std::strtof(value(), nullptr);
+    } else if (arg == "--integration") {
+      const std::string v = value();
+      if (v == "verlet") {
+        cfg.integration = IntegrationType::Verlet;
+      } else if (v == "euler") {
+        cfg.integration = IntegrationType::Euler;
+      } else {
+        std::cerr << "unknown integration: " << v << "\n";
+        return false;
+      }
+    } else if (arg == "--broadphase") {
+      const std::string v = value();
+      if (v == "grid") {
+        cfg.broadphase = BroadphaseType::UniformGrid;
+      } else if (v == "qtree") {
+        cfg.broadphase = BroadphaseType::Qtree;
+      } else if (v == "hgrid") {
+        cfg.broadphase = BroadphaseType::HierarchicalGrid;
+      } else if (v == "sap") {
+        cfg.broadphase = BroadphaseType::SweepAndPrune;
+      } else if (v == "naive") {
+        cfg.broadphase = BroadphaseType::Naive;
+      } else {
+        std::cerr << "unknown broadphase: " << v << "\n";
+        return false;
+      }
+    } else if (arg == "--grid") {
+      const std::string v = value();
+      if (v == "list") {
+        cfg.gridLayout = GridLayout::LinkedList;
+      } else if (v == "sorted") {
+        cfg.gridLayout = GridLayout::CountingSort;
+      } else {
+        std::cerr << "unknown grid layout: " << v << "\n";
+        return false;
+      }
+    } else if (arg == "--adaptive-grid") {
+      cfg.adaptiveGrid = true;
+    } else if (arg == "--sleep") {
+      cfg.sleeping = true;
+    } else if (arg == "--out") {
+      cfg.out = value();
+    } else if (arg == "--load") {
+      cfg.load = value();
+    } else if (arg == "--save") {
+      cfg.save = value();
+    } else if (arg == "--record") {
+      cfg.record = value();
+    } else if (arg == "--verify") {
+      cfg.verify = true;
+    } else if (arg == "--trace") {
+      cfg.trace = value();
+    } else if (arg == "--list") {
+      for (const Scenario& s : SCENARIOS) {
+        std::cout << s.name << "\t" << s.description << "\n";
+      }
+      std::exit(0);
+    } else if (arg == "--help" || arg == "-h") {
+      usage(std::cout, argv[0]);
+      std::exit(0);
+    } else {
+      usage(std::cerr, argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  BenchConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) return 2;
+  if (!cfg.trace.empty() && !Profiler::ENABLED) {
+    std::cerr << "--trace: built without RPENGINE_PROFILE, nothing to trace\n";
+  }
+  Profiler::setThreadName("main");
+
+  std::vector<const Scenario*> selected;
+  if (cfg.scenarios.empty()) {
+    for (const Scenario& s : SCENARIOS) selected.push_back(&s);
+  } else {
+    for (const std::string& name : cfg.scenarios) {
+      const Scenario* s = findScenario(name);
+      if (!s) {
+        std::cerr << "unknown scenario: " << name << "\n";
+        return 2;
+      }
+      selected.push_back(s);
+    }
+  }
+
+  std::vector<ScenarioResult> results;
+  for (const Scenario* s : selected) {
+    std::cerr << "running " << s->name << "...\n";
+    try {
+      results.push_back(runScenario(*s, cfg));
+      if (cfg.verify) verifyScenario(*s, cfg, results.back());
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  if (cfg.out.empty()) {
+    writeJson(std::cout, cfg, results);
+  } else {
+    std::ofstream file(cfg.out);
+    if (!file) {
+      std::cerr << "failed to open " << cfg.out << "\n";
+      return 1;
+    }
+    writeJson(file, cfg, results);
+  }
+
+  if (!cfg.trace.empty() && Profiler::ENABLED) {
+    try {
+      Profiler::writeChromeTrace(cfg.trace);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  // --verify doubles as a pass/fail check
+  for (const ScenarioResult& r : results) {
+    if (r.firstMismatch != SIZE_MAX) {
+      std::cerr << r.scenario->name
+                << " diverged from the 1-thread run at step "
+                << r.firstMismatch << "\n";
+      return 3;
+    }
+  }
+  return 0;
+}
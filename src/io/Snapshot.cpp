@@ -0,0 +1,196 @@
+#include <io/Endian.hpp>
+#include <io/MappedFile.hpp>
+#include <io/Snapshot.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr char MAGIC[8] = {'R', 'P', 'E', 'S', 'N', 'A', 'P', '\0'};
+static constexpr size_t HEADER_BYTES = 64;
+static constexpr size_t ENTRY_BYTES = 16;
+static constexpr size_t ARRAY_ALIGN = 64;
+
+// arrays hold 4 byte elements; on little-endian hosts they are copied as-is
+template <typename T>
+static void encodeArray(uint8_t* dst, const std::vector<T>& v) noexcept {
+  static_assert(sizeof(T) == 4, "snapshot arrays hold 4 byte elements");
+  if (hostIsLittleEndian()) {
+    if (!v.empty()) std::memcpy(dst, v.data(), v.size() * 4);
+    return;
+  }
+  for (size_t i = 0; i < v.size(); i++) {
+    uint32_t bits;
+    std::memcpy(&bits, &v[i], 4);
+    put32(dst + 4 * i, bits);
+  }
+}
+
+template <typename T>
+static void decodeArray(std::vector<T>& v, const uint8_t* src, size_t n) {
+  v.resize(n);
+  if (hostIsLittleEndian()) {
+    if (n) std::memcpy(v.data(), src, n * 4);
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t bits = get32(src + 4 * i);
+    std::memcpy(&v[i], &bits, 4);
+  }
+}
+
+static size_t alignUp(size_t v) noexcept {
+  return (v + ARRAY_ALIGN - 1) / ARRAY_ALIGN * ARRAY_ALIGN;
+}
+
+std::vector<uint8_t> Snapshot::capture(const Simulator& sim) {
+  const ParticleStore& ps = sim.particles_;
+  const size_t n = ps.size();
+
+  uint32_t arrays = 0;
+  ps.forEachArray([&](const char*, const auto&) { arrays++; });
+
+  const size_t tableEnd = HEADER_BYTES + ENTRY_BYTES * arrays;
+  size_t total = alignUp(tableEnd);
+  ps.forEachArray([&](const char*, const auto& v) {
+    total = alignUp(total + v.size() * sizeof(v[0]));
+  });
+
+  std::vector<uint8_t> image(total, 0);
+  uint8_t* h = image.data();
+  std::memcpy(h, MAGIC, 8);
+  put32(h + 8, VERSION);
+  put32(h + 12, arrays);
+  put64(h + 16, n);
+  putF32(h + 24, sim.worldSize_.x);
+  putF32(h + 28, sim.worldSize_.y);
+  putF32(h + 32, sim.gravity);
+  putF32(h + 36, sim.restitution);
+  putF32(h + 40, sim.dt_);
+  putF32(h + 44, sim.maxParticleRadius_);
+  put32(h + 48, static_cast<uint32_t>(sim.integrationType_));
+  put32(h + 52, static_cast<uint32_t>(sim.broadphaseType_));
+  put32(h + 56, static_cast<uint32_t>(sim.substeps_));
+
+  uint8_t* entry = h + HEADER_BYTES;
+  size_t offset = alignUp(tableEnd);
+  ps.forEachArray([&](const char* tag, const auto& v) {
+    std::memcpy(entry, tag, 4);
+    put32(entry + 4, sizeof(v[0]));
+    put64(entry + 8, offset);
+    encodeArray(image.data() + offset, v);
+    entry += ENTRY_BYTES;
+    offset = alignUp(offset + v.size() * sizeof(v[0]));
+  });
+  return image;
+}
+
+void Snapshot::write(const std::vector<uint8_t>& image,
+                     const std::string& path) {
+  // write next to the target and rename, so a crash never leaves a torn file
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(image.data()), image.size());
+    if (!out) throw std::runtime_error("Failed to write snapshot: " + tmp);
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(path.c_str());
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      throw std::runtime_error("Failed to replace snapshot: " + path);
+    }
+  }
+}
+
+void Snapshot::save(const Simulator& sim, const std::string& path) {
+  write(capture(sim), path);
+}
+
+std::future<void> Snapshot::saveAsync(const Simulator& sim,
+                                      const std::string& path) {
+  return std::async(std::launch::async,
+                    [image = capture(sim), path] { write(image, path); });
+}
+
+void Snapshot::load(Simulator& sim, const std::string& path) {
+  const MappedFile file(path);
+  const uint8_t* h = file.data();
+  auto fail = [&](const char* what) {
+    throw std::runtime_error(std::string(what) + ": " + path);
+  };
+
+  if (file.size() < HEADER_BYTES || std::memcmp(h, MAGIC, 8) != 0) {
+    fail("Not a snapshot");
+  }
+  if (get32(h + 8) != VERSION) fail("Unsupported snapshot version");
+
+  const uint32_t arrays = get32(h + 12);
+  const uint64_t n = get64(h + 16);
+  if (file.size() < HEADER_BYTES + ENTRY_BYTES * uint64_t(arrays)) {
+    fail("Truncated snapshot");
+  }
+  const uint32_t integration = get32(h + 48);
+  const uint32_t broadphase = get32(h + 52);
+  if (integration > static_cast<uint32_t>(IntegrationType::Verlet) ||
+      broadphase > static_cast<uint32_t>(BroadphaseType::HierarchicalGrid)) {
+    fail("Corrupt snapshot settings");
+  }
+  // a zero or NaN step never drains advance()'s accumulator, and a zero
+  // radius gives the grid zero-sized cells
+  const Vec2f world = {getF32(h + 24), getF32(h + 28)};
+  const float dt = getF32(h + 40);
+  const float maxRadius = getF32(h + 44);
+  if (!std::isfinite(world.x) || !std::isfinite(world.y) || world.x < 0.0f ||
+      world.y < 0.0f || !std::isfinite(dt) || dt <= 0.0f ||
+      !std::isfinite(maxRadius) || maxRadius <= 0.0f) {
+    fail("Corrupt snapshot settings");
+  }
+
+  // find every array and validate it before touching the simulator
+  auto findArray = [&](const char* tag) -> const uint8_t* {
+    for (uint32_t a = 0; a < arrays; a++) {
+      const uint8_t* entry = h + HEADER_BYTES + ENTRY_BYTES * a;
+      if (std::memcmp(entry, tag, 4) != 0) continue;
+      const uint64_t offset = get64(entry + 8);
+      if (get32(entry + 4) != 4 || offset > file.size() ||
+          (file.size() - offset) / 4 < n) {
+        fail("Truncated snapshot");
+      }
+      return h + offset;
+    }
+    return nullptr;
+  };
+
+  ParticleStore& ps = sim.particles_;
+  bool complete = true;
+  ps.forEachArray([&](const char* tag, auto&) {
+    const bool optional =
+        !std::strcmp(tag, "LX  ") || !std::strcmp(tag, "LY  ") ||
+        !std::strcmp(tag, "AX  ") || !std::strcmp(tag, "AY  ") ||
+        !std::strcmp(tag, "RS  ");
+    // optional arrays may be absent, but a present one must be whole
+    if (!findArray(tag) && !optional) complete = false;
+  });
+  if (!complete) fail("Snapshot is missing particle arrays");
+
+  ps.forEachArray([&](const char* tag, auto& v) {
+    if (const uint8_t* src = findArray(tag)) decodeArray(v, src, n);
+  });
+  if (!findArray("LX  ")) ps.lastX = ps.x;
+  if (!findArray("LY  ")) ps.lastY = ps.y;
+  if (!findArray("AX  ")) ps.ax.assign(n, 0.0f);
+  if (!findArray("AY  ")) ps.ay.assign(n, 0.0f);
+  if (!findArray("RS  ")) ps.rest.assign(n, 0);
+
+  sim.worldSize_ = world;
+  sim.gravity = getF32(h + 32);
+  sim.restitution = getF32(h + 36);
+  sim.dt_ = dt;
+  sim.maxParticleRadius_ = maxRadius;
+  sim.integrationType_ = static_cast<IntegrationType>(integration);
+  sim.broadphaseType_ = static_cast<BroadphaseType>(broadphase);
+  sim.setSubsteps(get32(h + 56));
+  sim.onParticlesReplaced();
+}
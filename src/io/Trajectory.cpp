@@ -0,0 +1,374 @@
+#include <Profiler.hpp>
+#include <io/Endian.hpp>
+#include <io/Trajectory.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+static constexpr char MAGIC[8] = {'R', 'P', 'E', 'T', 'R', 'A', 'J', '\0'};
+static constexpr char INDEX_MAGIC[8] = {'R', 'P', 'E', 'T',
+                                        'I', 'D', 'X', '\0'};
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t HEADER_BYTES = 32;
+static constexpr size_t CHUNK_HEADER_BYTES = 8;
+static constexpr size_t INDEX_ENTRY_BYTES = 24;
+static constexpr size_t FOOTER_BYTES = 24;
+static constexpr uint32_t NO_SLOT = 0xffffffffu;
+
+// escaped particles can sit further out than int32 steps reach; they are
+// pinned to the edge of the range (NaN to 0) rather than overflowing
+static int32_t quantize(float v, float invPrecision) noexcept {
+  const double q = std::round(double(v) * invPrecision);
+  if (q != q) return 0;
+  return static_cast<int32_t>(
+      std::clamp(q, double(std::numeric_limits<int32_t>::min()),
+                 double(std::numeric_limits<int32_t>::max())));
+}
+
+// --- recording ---
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path,
+                                       const Options& opts)
+    : opts_(opts),
+      out_(path, std::ios::binary | std::ios::trunc),
+      invPrecision_(1.0f / opts.precision) {
+  if (!out_) throw std::runtime_error("Failed to create trajectory: " + path);
+  opts_.framesPerChunk = std::max<size_t>(opts_.framesPerChunk, 1);
+  opts_.queueFrames = std::max<size_t>(opts_.queueFrames, 1);
+  for (size_t i = 0; i < opts_.queueFrames; i++) {
+    free_.push_back(std::make_unique<Frame>());
+  }
+  writeHeader(0);
+  writer_ = std::thread(&TrajectoryRecorder::writerLoop, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() { close(); }
+
+void TrajectoryRecorder::capture(const ParticleView& particles, uint64_t step,
+                                 float dt) {
+  std::unique_ptr<Frame> frame;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closing_) return;
+    if (free_.empty()) {
+      if (opts_.dropWhenFull) {
+        dropped_++;
+        return;
+      }
+      freed_.wait(lock, [&] { return !free_.empty(); });
+    }
+    frame = std::move(free_.back());
+    free_.pop_back();
+  }
+
+  const size_t n = particles.size();
+  frame->step = step;
+  frame->dt = dt;
+  frame->x.assign(particles.x, particles.x + n);
+  frame->y.assign(particles.y, particles.y + n);
+  frame->radius.assign(particles.radius, particles.radius + n);
+  frame->id.assign(particles.id, particles.id + n);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(frame));
+  }
+  ready_.notify_one();
+}
+
+void TrajectoryRecorder::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) return;
+    closed_ = true;
+    closing_ = true;
+  }
+  ready_.notify_one();
+  writer_.join();
+
+  flushChunk();
+  const uint64_t indexOffset = static_cast<uint64_t>(out_.tellp());
+  std::vector<uint8_t> bytes(INDEX_ENTRY_BYTES * index_.size() + FOOTER_BYTES);
+  uint8_t* p = bytes.data();
+  for (const ChunkEntry& c : index_) {
+    put64(p, c.offset);
+    put64(p + 8, c.firstFrame);
+    put32(p + 16, c.frames);
+    put32(p + 20, 0);
+    p += INDEX_ENTRY_BYTES;
+  }
+  put64(p, indexOffset);
+  put32(p + 8, static_cast<uint32_t>(index_.size()));
+  put32(p + 12, 0);
+  std::memcpy(p + 16, INDEX_MAGIC, 8);
+  out_.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+  writeHeader(written_);
+  out_.close();
+}
+
+uint64_t TrajectoryRecorder::framesWritten() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
+
+uint64_t TrajectoryRecorder::framesDropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+void TrajectoryRecorder::writerLoop() {
+  Profiler::setThreadName("trajectory writer", false);
+  for (;;) {
+    std::unique_ptr<Frame> frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [&] { return closing_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      frame = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    {
+      RPE_PROFILE_SCOPE("encode frame");
+      encode(*frame);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(std::move(frame));
+      written_++;
+    }
+    freed_.notify_one();
+  }
+}
+
+void TrajectoryRecorder::encode(const Frame& f) {
+  dt_ = f.dt;
+  // every chunk starts from a blank state so it can be decoded on its own
+  if (chunkFrames_ == 0) {
+    std::fill(lastQx_.begin(), lastQx_.end(), 0);
+    std::fill(lastQy_.begin(), lastQy_.end(), 0);
+    std::fill(seen_.begin(), seen_.end(), 0);
+  }
+
+  // visit particles in id order, whatever order the simulator keeps them in
+  uint32_t maxId = 0;
+  for (uint32_t id : f.id) maxId = std::max(maxId, id);
+  const size_t ids = f.id.empty() ? 0 : static_cast<size_t>(maxId) + 1;
+  if (lastQx_.size() < ids) {
+    lastQx_.resize(ids, 0);
+    lastQy_.resize(ids, 0);
+    seen_.resize(ids, 0);
+  }
+  slotOf_.assign(ids, NO_SLOT);
+  for (size_t i = 0; i < f.id.size(); i++) {
+    slotOf_[f.id[i]] = static_cast<uint32_t>(i);
+  }
+
+  putVarint(chunk_, f.step);
+  putVarint(chunk_, f.id.size());
+  int64_t prevId = -1;
+  for (size_t id = 0; id < ids; id++) {
+    const uint32_t i = slotOf_[id];
+    if (i == NO_SLOT) continue;
+
+    const int32_t qx = quantize(f.x[i], invPrecision_);
+    const int32_t qy = quantize(f.y[i], invPrecision_);
+    putVarint(chunk_, static_cast<uint64_t>(int64_t(id) - prevId - 1));
+    putVarint(chunk_, zigzag(int64_t(qx) - lastQx_[id]));
+    putVarint(chunk_, zigzag(int64_t(qy) - lastQy_[id]));
+    if (!seen_[id]) {
+      seen_[id] = 1;
+      uint8_t r[4];
+      putF32(r, f.radius[i]);
+      chunk_.insert(chunk_.end(), r, r + 4);
+    }
+    lastQx_[id] = qx;
+    lastQy_[id] = qy;
+    prevId = static_cast<int64_t>(id);
+  }
+
+  if (++chunkFrames_ >= opts_.framesPerChunk) flushChunk();
+}
+
+void TrajectoryRecorder::flushChunk() {
+  if (chunkFrames_ == 0) return;
+  const uint64_t firstFrame =
+      index_.empty() ? 0 : index_.back().firstFrame + index_.back().frames;
+  index_.push_back({static_cast<uint64_t>(out_.tellp()), firstFrame,
+                    chunkFrames_});
+
+  uint8_t header[CHUNK_HEADER_BYTES];
+  put32(header, chunkFrames_);
+  put32(header + 4, static_cast<uint32_t>(chunk_.size()));
+  out_.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out_.write(reinterpret_cast<const char*>(chunk_.data()), chunk_.size());
+  writeHeader(firstFrame + chunkFrames_);
+  chunk_.clear();
+  chunkFrames_ = 0;
+}
+
+void TrajectoryRecorder::writeHeader(uint64_t frames) {
+  uint8_t h[HEADER_BYTES];
+  std::memcpy(h, MAGIC, 8);
+  put32(h + 8, VERSION);
+  put32(h + 12, static_cast<uint32_t>(opts_.framesPerChunk));
+  putF32(h + 16, opts_.precision);
+  putF32(h + 20, dt_);
+  put64(h + 24, frames);
+
+  const auto end = out_.tellp();
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(h), sizeof(h));
+  if (end > 0) out_.seekp(end);
+}
+
+// --- playback ---
+
+TrajectoryReader::TrajectoryReader(const std::string& path) : file_(path) {
+  const uint8_t* data = file_.data();
+  const size_t size = file_.size();
+  if (size < HEADER_BYTES || std::memcmp(data, MAGIC, 8) != 0) {
+    throw std::runtime_error("Not a trajectory: " + path);
+  }
+  if (get32(data + 8) != VERSION) {
+    throw std::runtime_error("Unsupported trajectory version: " + path);
+  }
+  precision_ = getF32(data + 16);
+  dt_ = getF32(data + 20);
+
+  // prefer the index; fall back to walking the chunks of an unclosed file
+  const uint8_t* footer = data + size - FOOTER_BYTES;
+  if (size >= HEADER_BYTES + FOOTER_BYTES &&
+      std::memcmp(footer + 16, INDEX_MAGIC, 8) == 0) {
+    const uint64_t indexOffset = get64(footer);
+    const uint32_t chunks = get32(footer + 8);
+    if (indexOffset > size - FOOTER_BYTES ||
+        (size - FOOTER_BYTES - indexOffset) / INDEX_ENTRY_BYTES < chunks) {
+      throw std::runtime_error("Corrupt trajectory index: " + path);
+    }
+    for (uint32_t c = 0; c < chunks; c++) {
+      const uint8_t* e = data + indexOffset + INDEX_ENTRY_BYTES * c;
+      index_.push_back({get64(e), get64(e + 8), get32(e + 16)});
+    }
+  } else {
+    scanChunks(HEADER_BYTES);
+  }
+
+  for (const ChunkEntry& c : index_) {
+    if (c.offset > size || size - c.offset < CHUNK_HEADER_BYTES ||
+        size - c.offset - CHUNK_HEADER_BYTES < get32(data + c.offset + 4)) {
+      throw std::runtime_error("Corrupt trajectory chunk: " + path);
+    }
+  }
+  if (!index_.empty()) {
+    frames_ = index_.back().firstFrame + index_.back().frames;
+  }
+}
+
+void TrajectoryReader::scanChunks(size_t offset) {
+  const size_t size = file_.size();
+  uint64_t firstFrame = 0;
+  while (size - offset >= CHUNK_HEADER_BYTES) {
+    const uint32_t frames = get32(file_.data() + offset);
+    const uint32_t bytes = get32(file_.data() + offset + 4);
+    if (frames == 0 || size - offset - CHUNK_HEADER_BYTES < bytes) break;
+    index_.push_back({offset, firstFrame, frames});
+    firstFrame += frames;
+    offset += CHUNK_HEADER_BYTES + bytes;
+  }
+}
+
+size_t TrajectoryReader::chunkOf(size_t f) const noexcept {
+  const auto it = std::upper_bound(
+      index_.begin(), index_.end(), f,
+      [](size_t frame, const ChunkEntry& c) { return frame < c.firstFrame; });
+  return static_cast<size_t>(it - index_.begin()) - 1;
+}
+
+void TrajectoryReader::startChunk(size_t c) {
+  const ChunkEntry& entry = index_[c];
+  const uint8_t* header = file_.data() + entry.offset;
+  chunk_ = c;
+  nextFrame_ = entry.firstFrame;
+  cursor_ = header + CHUNK_HEADER_BYTES;
+  chunkEnd_ = cursor_ + get32(header + 4);
+  std::fill(lastQx_.begin(), lastQx_.end(), 0);
+  std::fill(lastQy_.begin(), lastQy_.end(), 0);
+  std::fill(seen_.begin(), seen_.end(), 0);
+}
+
+void TrajectoryReader::readFrame(size_t f, TrajectoryFrame& out) {
+  if (f >= frames_) throw std::runtime_error("Trajectory frame out of range");
+  const size_t c = chunkOf(f);
+  if (c != chunk_ || f < nextFrame_) startChunk(c);
+  while (nextFrame_ <= f) decodeFrame(out);
+}
+
+void TrajectoryReader::prefetch(size_t f) const noexcept {
+#ifndef _WIN32
+  if (f >= frames_) return;
+  const ChunkEntry& entry = index_[chunkOf(f)];
+  const uint8_t* begin = file_.data() + entry.offset;
+  const size_t bytes = CHUNK_HEADER_BYTES + get32(begin + 4);
+  // madvise wants a page aligned start
+  const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+  const uintptr_t start = reinterpret_cast<uintptr_t>(begin) & ~(page - 1);
+  ::madvise(reinterpret_cast<void*>(start),
+            reinterpret_cast<uintptr_t>(begin) + bytes - start, MADV_WILLNEED);
+#else
+  (void)f;
+#endif
+}
+
+void TrajectoryReader::decodeFrame(TrajectoryFrame& out) {
+  auto next = [&]() -> uint64_t {
+    uint64_t v;
+    cursor_ = getVarint(cursor_, chunkEnd_, v);
+    if (!cursor_) throw std::runtime_error("Corrupt trajectory frame");
+    return v;
+  };
+
+  out.step = next();
+  const size_t n = next();
+  out.x.resize(n);
+  out.y.resize(n);
+  out.radius.resize(n);
+  out.id.resize(n);
+
+  int64_t prevId = -1;
+  for (size_t k = 0; k < n; k++) {
+    const int64_t id = prevId + 1 + static_cast<int64_t>(next());
+    if (id > UINT32_MAX) throw std::runtime_error("Corrupt trajectory frame");
+    if (static_cast<size_t>(id) >= lastQx_.size()) {
+      const size_t grow = std::max<size_t>(id + 1, lastQx_.size() * 2);
+      lastQx_.resize(grow, 0);
+      lastQy_.resize(grow, 0);
+      radius_.resize(grow, 0.0f);
+      seen_.resize(grow, 0);
+    }
+
+    const int32_t qx = static_cast<int32_t>(lastQx_[id] + unzigzag(next()));
+    const int32_t qy = static_cast<int32_t>(lastQy_[id] + unzigzag(next()));
+    if (!seen_[id]) {
+      if (chunkEnd_ - cursor_ < 4) {
+        throw std::runtime_error("Corrupt trajectory frame");
+      }
+      radius_[id] = getF32(cursor_);
+      cursor_ += 4;
+      seen_[id] = 1;
+    }
+    lastQx_[id] = qx;
+    lastQy_[id] = qy;
+
+    out.x[k] = qx * precision_;
+    out.y[k] = qy * precision_;
+    out.radius[k] = radius_[id];
+    out.id[k] = static_cast<uint32_t>(id);
+    prevId = id;
+  }
+  nextFrame_++;
+}
@@ -1,18 +1,35 @@
+#include <Profiler.hpp>
 #include <Simulator.hpp>
+#include <chrono>
 #include <ui/Renderer.hpp>
 
 int main() {
+  Profiler::setThreadName("main");
+
   // NOTE: running sim w/ Euler integration makes some really cool fx
   // Simulator sim({0.0f, 0.0f}, 2.0f, 0.0f, 0.0f, 0.0f, IntegrationType::Euler,
   //               BroadphaseType::UniformGrid, 12000);
   Simulator sim({0.0f, 0.0f}, 2.0f, 0.0f, 0.0f, 0.0, IntegrationType::Verlet,
                 BroadphaseType::UniformGrid, 50000);
 
-  Renderer renderer(sim, Renderer::Options{60, "RPEngine"});
+  Renderer renderer(sim, Renderer::Options{60, "RPEngine", false});
+
+  // physics steps at a fixed rate of its own (the renderer starts it at the
+  // fps limit); frames interpolate between steps
+  sim.setSubsteps(1);
+  sim.setMaxCatchUpSteps(4);
 
+  using Clock = std::chrono::steady_clock;
+  auto lastFrame = Clock::now();
   while (renderer.isOpen()) {
     renderer.pollAndHandleEvents();
-    sim.update();
+    const auto now = Clock::now();
+    // press T to hand stepping over to the renderer's simulation thread, P
+    // to watch a recording instead
+    if (!renderer.threadedSimulation() && !renderer.replaying()) {
+      sim.advance(std::chrono::duration<double>(now - lastFrame).count());
+    }
+    lastFrame = now;
     renderer.drawFrame();
   }
   return 0;
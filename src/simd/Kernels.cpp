@@ -0,0 +1,434 @@
+#include <atomic>
+#include <simd/Kernels.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RP_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// --- scalar reference ---
+// the vector paths below evaluate the exact same operations in the same order,
+// so every level produces bit-identical results. Walls is a template argument
+// so the variant without walls carries no trace of them
+
+template <bool Walls>
+static void verletScalar(const KernelArrays& a, size_t begin, size_t end,
+                         const KernelParams& p) noexcept {
+  const float dt2 = p.dt * p.dt;
+  for (size_t i = begin; i < end; i++) {
+    if (a.rest[i] >= p.sleepSteps) {
+      a.ax[i] = 0.0f;
+      a.ay[i] = 0.0f;
+      continue;
+    }
+    const float r = a.radius[i];
+    const float x = a.x[i];
+    const float y = a.y[i];
+    float nx = x + (x - a.prevX[i]) + a.ax[i] * dt2;
+    float ny = y + (y - a.prevY[i]) + (a.ay[i] + p.gravity) * dt2;
+    float px = x;
+    float py = y;
+    const float vx = nx - x;
+    const float vy = ny - y;
+
+    if constexpr (Walls) {
+      // top/bot
+      if (ny < r) {
+        ny = r;
+        py = ny + vy * p.restitution;
+      } else if (ny > p.height - r) {
+        ny = p.height - r;
+        py = ny + vy * p.restitution;
+      }
+
+      // left/right
+      if (nx < r) {
+        nx = r;
+        px = nx + vx * p.restitution;
+      } else if (nx > p.width - r) {
+        nx = p.width - r;
+        px = nx + vx * p.restitution;
+      }
+    }
+
+    a.x[i] = nx;
+    a.y[i] = ny;
+    a.prevX[i] = px;
+    a.prevY[i] = py;
+    a.ax[i] = 0.0f;
+    a.ay[i] = 0.0f;
+  }
+}
+
+template <bool Walls>
+static void eulerScalar(const KernelArrays& a, size_t begin, size_t end,
+                        const KernelParams& p) noexcept {
+  for (size_t i = begin; i < end; i++) {
+    if (a.rest[i] >= p.sleepSteps) {
+      a.ax[i] = 0.0f;
+      a.ay[i] = 0.0f;
+      continue;
+    }
+    const float r = a.radius[i];
+    float vx = a.vx[i] + a.ax[i] * p.dt;
+    float vy = a.vy[i] + (a.ay[i] + p.gravity) * p.dt;
+    float x = a.x[i] + vx * p.dt;
+    float y = a.y[i] + vy * p.dt;
+
+    if constexpr (Walls) {
+      // top/bot
+      if (y < r) {
+        y = r;
+        vy = -vy * p.restitution;
+      } else if (y > p.height - r) {
+        y = p.height - r;
+        vy = -vy * p.restitution;
+      }
+
+      // left/right
+      if (x < r) {
+        x = r;
+        vx = -vx * p.restitution;
+      } else if (x > p.width - r) {
+        x = p.width - r;
+        vx = -vx * p.restitution;
+      }
+    }
+
+    a.x[i] = x;
+    a.y[i] = y;
+    a.vx[i] = vx;
+    a.vy[i] = vy;
+    a.ax[i] = 0.0f;
+    a.ay[i] = 0.0f;
+  }
+}
+
+#ifdef RP_SIMD_X86
+
+// --- SSE2, 4 lanes ---
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) noexcept {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+template <bool Walls>
+__attribute__((target("sse2"))) static void verletSSE2(
+    const KernelArrays& a, size_t begin, size_t end,
+    const KernelParams& p) noexcept {
+  const __m128 dt2 = _mm_set1_ps(p.dt * p.dt);
+  const __m128 g = _mm_set1_ps(p.gravity);
+  const __m128 w = _mm_set1_ps(p.width);
+  const __m128 h = _mm_set1_ps(p.height);
+  const __m128 rest = _mm_set1_ps(p.restitution);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128i awakeMax = _mm_set1_epi32(static_cast<int>(p.sleepSteps) - 1);
+
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 sleep = _mm_castsi128_ps(_mm_cmpgt_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.rest + i)),
+        awakeMax));
+    const __m128 r = _mm_loadu_ps(a.radius + i);
+    const __m128 x = _mm_loadu_ps(a.x + i);
+    const __m128 y = _mm_loadu_ps(a.y + i);
+    const __m128 prx = _mm_loadu_ps(a.prevX + i);
+    const __m128 pry = _mm_loadu_ps(a.prevY + i);
+    const __m128 ax = _mm_loadu_ps(a.ax + i);
+    const __m128 ay = _mm_add_ps(_mm_loadu_ps(a.ay + i), g);
+
+    __m128 nx = _mm_add_ps(_mm_add_ps(x, _mm_sub_ps(x, prx)),
+                           _mm_mul_ps(ax, dt2));
+    __m128 ny = _mm_add_ps(_mm_add_ps(y, _mm_sub_ps(y, pry)),
+                           _mm_mul_ps(ay, dt2));
+    const __m128 vx = _mm_sub_ps(nx, x);
+    const __m128 vy = _mm_sub_ps(ny, y);
+    __m128 px = x;
+    __m128 py = y;
+
+    if constexpr (Walls) {
+      // top/bot
+      const __m128 hr = _mm_sub_ps(h, r);
+      const __m128 loY = _mm_cmplt_ps(ny, r);
+      const __m128 hiY = _mm_andnot_ps(loY, _mm_cmpgt_ps(ny, hr));
+      ny = select4(loY, r, select4(hiY, hr, ny));
+      py = select4(_mm_or_ps(loY, hiY), _mm_add_ps(ny, _mm_mul_ps(vy, rest)),
+                   y);
+
+      // left/right
+      const __m128 wr = _mm_sub_ps(w, r);
+      const __m128 loX = _mm_cmplt_ps(nx, r);
+      const __m128 hiX = _mm_andnot_ps(loX, _mm_cmpgt_ps(nx, wr));
+      nx = select4(loX, r, select4(hiX, wr, nx));
+      px = select4(_mm_or_ps(loX, hiX), _mm_add_ps(nx, _mm_mul_ps(vx, rest)),
+                   x);
+    }
+
+    _mm_storeu_ps(a.x + i, select4(sleep, x, nx));
+    _mm_storeu_ps(a.y + i, select4(sleep, y, ny));
+    _mm_storeu_ps(a.prevX + i, select4(sleep, prx, px));
+    _mm_storeu_ps(a.prevY + i, select4(sleep, pry, py));
+    _mm_storeu_ps(a.ax + i, zero);
+    _mm_storeu_ps(a.ay + i, zero);
+  }
+  verletScalar<Walls>(a, i, end, p);
+}
+
+template <bool Walls>
+__attribute__((target("sse2"))) static void eulerSSE2(
+    const KernelArrays& a, size_t begin, size_t end,
+    const KernelParams& p) noexcept {
+  const __m128 dt = _mm_set1_ps(p.dt);
+  const __m128 g = _mm_set1_ps(p.gravity);
+  const __m128 w = _mm_set1_ps(p.width);
+  const __m128 h = _mm_set1_ps(p.height);
+  const __m128 rest = _mm_set1_ps(p.restitution);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128i awakeMax = _mm_set1_epi32(static_cast<int>(p.sleepSteps) - 1);
+
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 sleep = _mm_castsi128_ps(_mm_cmpgt_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.rest + i)),
+        awakeMax));
+    const __m128 r = _mm_loadu_ps(a.radius + i);
+    const __m128 x0 = _mm_loadu_ps(a.x + i);
+    const __m128 y0 = _mm_loadu_ps(a.y + i);
+    const __m128 vx0 = _mm_loadu_ps(a.vx + i);
+    const __m128 vy0 = _mm_loadu_ps(a.vy + i);
+    const __m128 ay = _mm_add_ps(_mm_loadu_ps(a.ay + i), g);
+    __m128 vx = _mm_add_ps(vx0, _mm_mul_ps(_mm_loadu_ps(a.ax + i), dt));
+    __m128 vy = _mm_add_ps(vy0, _mm_mul_ps(ay, dt));
+    __m128 x = _mm_add_ps(x0, _mm_mul_ps(vx, dt));
+    __m128 y = _mm_add_ps(y0, _mm_mul_ps(vy, dt));
+
+    if constexpr (Walls) {
+      // top/bot
+      const __m128 hr = _mm_sub_ps(h, r);
+      const __m128 loY = _mm_cmplt_ps(y, r);
+      const __m128 hiY = _mm_andnot_ps(loY, _mm_cmpgt_ps(y, hr));
+      y = select4(loY, r, select4(hiY, hr, y));
+      vy = select4(_mm_or_ps(loY, hiY),
+                   _mm_mul_ps(_mm_xor_ps(vy, sign), rest), vy);
+
+      // left/right
+      const __m128 wr = _mm_sub_ps(w, r);
+      const __m128 loX = _mm_cmplt_ps(x, r);
+      const __m128 hiX = _mm_andnot_ps(loX, _mm_cmpgt_ps(x, wr));
+      x = select4(loX, r, select4(hiX, wr, x));
+      vx = select4(_mm_or_ps(loX, hiX),
+                   _mm_mul_ps(_mm_xor_ps(vx, sign), rest), vx);
+    }
+
+    _mm_storeu_ps(a.x + i, select4(sleep, x0, x));
+    _mm_storeu_ps(a.y + i, select4(sleep, y0, y));
+    _mm_storeu_ps(a.vx + i, select4(sleep, vx0, vx));
+    _mm_storeu_ps(a.vy + i, select4(sleep, vy0, vy));
+    _mm_storeu_ps(a.ax + i, zero);
+    _mm_storeu_ps(a.ay + i, zero);
+  }
+  eulerScalar<Walls>(a, i, end, p);
+}
+
+// --- AVX2, 8 lanes ---
+
+template <bool Walls>
+__attribute__((target("avx2"))) static void verletAVX2(
+    const KernelArrays& a, size_t begin, size_t end,
+    const KernelParams& p) noexcept {
+  const __m256 dt2 = _mm256_set1_ps(p.dt * p.dt);
+  const __m256 g = _mm256_set1_ps(p.gravity);
+  const __m256 w = _mm256_set1_ps(p.width);
+  const __m256 h = _mm256_set1_ps(p.height);
+  const __m256 rest = _mm256_set1_ps(p.restitution);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i awakeMax =
+      _mm256_set1_epi32(static_cast<int>(p.sleepSteps) - 1);
+
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 sleep = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.rest + i)),
+        awakeMax));
+    const __m256 r = _mm256_loadu_ps(a.radius + i);
+    const __m256 x = _mm256_loadu_ps(a.x + i);
+    const __m256 y = _mm256_loadu_ps(a.y + i);
+    const __m256 prx = _mm256_loadu_ps(a.prevX + i);
+    const __m256 pry = _mm256_loadu_ps(a.prevY + i);
+    const __m256 ax = _mm256_loadu_ps(a.ax + i);
+    const __m256 ay = _mm256_add_ps(_mm256_loadu_ps(a.ay + i), g);
+
+    __m256 nx = _mm256_add_ps(_mm256_add_ps(x, _mm256_sub_ps(x, prx)),
+                              _mm256_mul_ps(ax, dt2));
+    __m256 ny = _mm256_add_ps(_mm256_add_ps(y, _mm256_sub_ps(y, pry)),
+                              _mm256_mul_ps(ay, dt2));
+    const __m256 vx = _mm256_sub_ps(nx, x);
+    const __m256 vy = _mm256_sub_ps(ny, y);
+    __m256 px = x;
+    __m256 py = y;
+
+    if constexpr (Walls) {
+      // top/bot
+      const __m256 hr = _mm256_sub_ps(h, r);
+      const __m256 loY = _mm256_cmp_ps(ny, r, _CMP_LT_OQ);
+      const __m256 hiY =
+          _mm256_andnot_ps(loY, _mm256_cmp_ps(ny, hr, _CMP_GT_OQ));
+      ny = _mm256_blendv_ps(_mm256_blendv_ps(ny, hr, hiY), r, loY);
+      py = _mm256_blendv_ps(y, _mm256_add_ps(ny, _mm256_mul_ps(vy, rest)),
+                            _mm256_or_ps(loY, hiY));
+
+      // left/right
+      const __m256 wr = _mm256_sub_ps(w, r);
+      const __m256 loX = _mm256_cmp_ps(nx, r, _CMP_LT_OQ);
+      const __m256 hiX =
+          _mm256_andnot_ps(loX, _mm256_cmp_ps(nx, wr, _CMP_GT_OQ));
+      nx = _mm256_blendv_ps(_mm256_blendv_ps(nx, wr, hiX), r, loX);
+      px = _mm256_blendv_ps(x, _mm256_add_ps(nx, _mm256_mul_ps(vx, rest)),
+                            _mm256_or_ps(loX, hiX));
+    }
+
+    _mm256_storeu_ps(a.x + i, _mm256_blendv_ps(nx, x, sleep));
+    _mm256_storeu_ps(a.y + i, _mm256_blendv_ps(ny, y, sleep));
+    _mm256_storeu_ps(a.prevX + i, _mm256_blendv_ps(px, prx, sleep));
+    _mm256_storeu_ps(a.prevY + i, _mm256_blendv_ps(py, pry, sleep));
+    _mm256_storeu_ps(a.ax + i, zero);
+    _mm256_storeu_ps(a.ay + i, zero);
+  }
+  verletScalar<Walls>(a, i, end, p);
+}
+
+template <bool Walls>
+__attribute__((target("avx2"))) static void eulerAVX2(
+    const KernelArrays& a, size_t begin, size_t end,
+    const KernelParams& p) noexcept {
+  const __m256 dt = _mm256_set1_ps(p.dt);
+  const __m256 g = _mm256_set1_ps(p.gravity);
+  const __m256 w = _mm256_set1_ps(p.width);
+  const __m256 h = _mm256_set1_ps(p.height);
+  const __m256 rest = _mm256_set1_ps(p.restitution);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256i awakeMax =
+      _mm256_set1_epi32(static_cast<int>(p.sleepSteps) - 1);
+
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 sleep = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.rest + i)),
+        awakeMax));
+    const __m256 r = _mm256_loadu_ps(a.radius + i);
+    const __m256 x0 = _mm256_loadu_ps(a.x + i);
+    const __m256 y0 = _mm256_loadu_ps(a.y + i);
+    const __m256 vx0 = _mm256_loadu_ps(a.vx + i);
+    const __m256 vy0 = _mm256_loadu_ps(a.vy + i);
+    const __m256 ay = _mm256_add_ps(_mm256_loadu_ps(a.ay + i), g);
+    __m256 vx =
+        _mm256_add_ps(vx0, _mm256_mul_ps(_mm256_loadu_ps(a.ax + i), dt));
+    __m256 vy = _mm256_add_ps(vy0, _mm256_mul_ps(ay, dt));
+    __m256 x = _mm256_add_ps(x0, _mm256_mul_ps(vx, dt));
+    __m256 y = _mm256_add_ps(y0, _mm256_mul_ps(vy, dt));
+
+    if constexpr (Walls) {
+      // top/bot
+      const __m256 hr = _mm256_sub_ps(h, r);
+      const __m256 loY = _mm256_cmp_ps(y, r, _CMP_LT_OQ);
+      const __m256 hiY =
+          _mm256_andnot_ps(loY, _mm256_cmp_ps(y, hr, _CMP_GT_OQ));
+      y = _mm256_blendv_ps(_mm256_blendv_ps(y, hr, hiY), r, loY);
+      vy = _mm256_blendv_ps(vy,
+                            _mm256_mul_ps(_mm256_xor_ps(vy, sign), rest),
+                            _mm256_or_ps(loY, hiY));
+
+      // left/right
+      const __m256 wr = _mm256_sub_ps(w, r);
+      const __m256 loX = _mm256_cmp_ps(x, r, _CMP_LT_OQ);
+      const __m256 hiX =
+          _mm256_andnot_ps(loX, _mm256_cmp_ps(x, wr, _CMP_GT_OQ));
+      x = _mm256_blendv_ps(_mm256_blendv_ps(x, wr, hiX), r, loX);
+      vx = _mm256_blendv_ps(vx,
+                            _mm256_mul_ps(_mm256_xor_ps(vx, sign), rest),
+                            _mm256_or_ps(loX, hiX));
+    }
+
+    _mm256_storeu_ps(a.x + i, _mm256_blendv_ps(x, x0, sleep));
+    _mm256_storeu_ps(a.y + i, _mm256_blendv_ps(y, y0, sleep));
+    _mm256_storeu_ps(a.vx + i, _mm256_blendv_ps(vx, vx0, sleep));
+    _mm256_storeu_ps(a.vy + i, _mm256_blendv_ps(vy, vy0, sleep));
+    _mm256_storeu_ps(a.ax + i, zero);
+    _mm256_storeu_ps(a.ay + i, zero);
+  }
+  eulerScalar<Walls>(a, i, end, p);
+}
+
+#endif  // RP_SIMD_X86
+
+// --- dispatch ---
+
+static std::atomic<SimdLevel> currentLevel{simd::detect()};
+
+SimdLevel simd::detect() noexcept {
+#ifdef RP_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#endif
+  return SimdLevel::Scalar;
+}
+
+SimdLevel simd::level() noexcept {
+  return currentLevel.load(std::memory_order_relaxed);
+}
+
+void simd::setLevel(SimdLevel level) noexcept {
+  const SimdLevel best = detect();
+  currentLevel.store(static_cast<int>(level) > static_cast<int>(best) ? best
+                                                                      : level,
+                     std::memory_order_relaxed);
+}
+
+const char* simd::name(SimdLevel level) noexcept {
+  switch (level) {
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::SSE2:
+      return "sse2";
+    case SimdLevel::Scalar:
+      return "scalar";
+  }
+  return "unknown";
+}
+
+void simd::integrateVerlet(const KernelArrays& a, size_t begin, size_t end,
+                           const KernelParams& p) noexcept {
+  switch (level()) {
+#ifdef RP_SIMD_X86
+    case SimdLevel::AVX2:
+      return p.walls ? verletAVX2<true>(a, begin, end, p)
+                     : verletAVX2<false>(a, begin, end, p);
+    case SimdLevel::SSE2:
+      return p.walls ? verletSSE2<true>(a, begin, end, p)
+                     : verletSSE2<false>(a, begin, end, p);
+#endif
+    default:
+      return p.walls ? verletScalar<true>(a, begin, end, p)
+                     : verletScalar<false>(a, begin, end, p);
+  }
+}
+
+void simd::integrateEuler(const KernelArrays& a, size_t begin, size_t end,
+                          const KernelParams& p) noexcept {
+  switch (level()) {
+#ifdef RP_SIMD_X86
+    case SimdLevel::AVX2:
+      return p.walls ? eulerAVX2<true>(a, begin, end, p)
+                     : eulerAVX2<false>(a, begin, end, p);
+    case SimdLevel::SSE2:
+      return p.walls ? eulerSSE2<true>(a, begin, end, p)
+                     : eulerSSE2<false>(a, begin, end, p);
+#endif
+    default:
+      return p.walls ? eulerScalar<true>(a, begin, end, p)
+                     : eulerScalar<false>(a, begin, end, p);
+  }
+}
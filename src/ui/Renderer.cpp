@@ -1,4 +1,10 @@
 #include <SFML/Graphics/Color.hpp>
+#include <cmath>
+#include <cstdio>
+#include <io/Snapshot.hpp>
+#include <iostream>
+#include <limits>
+#include <string_view>
 #include <ui/Renderer.hpp>
 
 Renderer::Renderer(Simulator& sim, const Options& opts)
@@ -6,22 +12,22 @@ Renderer::Renderer(Simulator& sim, const Options& opts)
       window_(
           sf::RenderWindow(sf::VideoMode(sf::VideoMode::getDesktopMode().size),
                            opts.window_title)),
-      gSlider_({40.0f, 0.0f}, {200.0f, 10.0f}, {-100.0f, 100.0f}, sim_.gravity,
+      gSlider_({40.0f, 0.0f}, {200.0f, 10.0f}, {-100.0f, 100.0f}, gravity_,
                font_, "Gravity"),
-      eSlider_({40.0f, 0.0f}, {200.0f, 10.0f}, {0.0f, 1.0f}, sim_.restitution,
+      eSlider_({40.0f, 0.0f}, {200.0f, 10.0f}, {0.0f, 1.0f}, restitution_,
                font_, "Restitution", sf::Color::White, sf::Color::Yellow),
       particleCountText_(font_, "Particles: ", 30),
-      fpsText_(font_, "FPS: 60", 30) {
+      fpsText_(font_, "FPS: 60", 30),
+      replayText_(font_, "", 30),
+      particleBuffer_(sf::PrimitiveType::Triangles,
+                      sf::VertexBuffer::Usage::Stream),
+      vertexPool_(std::max(1u, std::thread::hardware_concurrency() / 2)) {
   window_.setFramerateLimit(opts.fps_limit);
   lastSize_ = window_.getSize();
   sim_.configure(
       {static_cast<float>(lastSize_.x), static_cast<float>(lastSize_.y)},
       1.0f / static_cast<float>(opts.fps_limit));
 
-  gen_ = std::mt19937(std::random_device{}());
-  distX = std::uniform_real_distribution<float>(0.0f, lastSize_.x - 20.0f);
-  distY = std::uniform_real_distribution<float>(0.0f, lastSize_.y - 20.0f);
-
   // load font
   if (!font_.openFromFile("assets/pixelated.ttf")) {
     throw std::runtime_error("Failed to load font: assets/pixelated.ttf");
@@ -30,17 +36,64 @@ Renderer::Renderer(Simulator& sim, const Options& opts)
   particleSize_ = sim.maxParticleRadius();
 
   // set vertex array things
-  particleVertices_.setPrimitiveType(sf::PrimitiveType::Triangles);
   computeUnitCircle();
+  if (!buildParticleTexture()) renderMode_ = ParticleRenderMode::TriangleFans;
 
   // initialize fps measurement arrays
   frameTimes_.fill(1.0f / static_cast<float>(opts.fps_limit));
+  frameBudget_ = 1.0f / static_cast<float>(opts.fps_limit);
 
   runtimeClock_.start();
 
   colorLUT_.assign(sim_.capacity(), std::optional<sf::Color>());
 
   layoutUI();
+
+  sim_.gravity = syncedGravity_ = gravity_;
+  sim_.restitution = syncedRestitution_ = restitution_;
+  simThread_ = std::make_unique<SimulationThread>(sim_);
+  setThreadedSimulation(opts.threaded_simulation);
+}
+
+Renderer::~Renderer() {
+  // the simulator outlives us and must stop feeding our recorder first
+  setThreadedSimulation(false);
+  sim_.setRecorder(nullptr);
+}
+
+void Renderer::setThreadedSimulation(bool threaded) {
+  if (threaded) {
+    simThread_->start();
+  } else {
+    simThread_->stop();
+  }
+}
+
+ParticleView Renderer::particleView(float* alpha) noexcept {
+  if (replaying()) {
+    if (alpha) *alpha = static_cast<float>(replayFrame_ - replayFromIndex_);
+    return {replayTo_.x.data(),      replayTo_.y.data(),
+            replayLastX_.data(),     replayLastY_.data(),
+            replayTo_.radius.data(), replayTo_.id.data(),
+            replayTo_.x.size()};
+  }
+  if (threadedSimulation()) {
+    const RenderSnapshot& snap = simThread_->latest();
+    if (alpha) *alpha = snap.interpolationAlpha();
+    return snap.view();
+  }
+  if (alpha) *alpha = sim_.interpolationAlpha();
+  return sim_.particles();
+}
+
+void Renderer::syncSettings() {
+  if (gravity_ == syncedGravity_ && restitution_ == syncedRestitution_) return;
+  syncedGravity_ = gravity_;
+  syncedRestitution_ = restitution_;
+  withSim([g = gravity_, e = restitution_](Simulator& sim) {
+    sim.gravity = g;
+    sim.restitution = e;
+  });
 }
 
 void Renderer::pollAndHandleEvents() noexcept {
@@ -61,16 +114,22 @@ void Renderer::pollAndHandleEvents() noexcept {
 }
 
 void Renderer::drawFrame() {
+  Profiler::markFrame();
+  syncSettings();
   updateText();
-  randomSpawn();
-  streamSpawn();
-  randomSpawnSUPERFAST();
-  spawnMax();
-  radialPush(10);
+  if (replaying()) {
+    advanceReplay();
+  } else {
+    spawnMax();
+    radialPush(10);
+  }
   window_.clear();
   drawParticles();
   drawComponents();
-  window_.display();
+  {
+    RPE_PROFILE_SCOPE("display");
+    window_.display();
+  }
 }
 
 void Renderer::computeUnitCircle() {
@@ -88,6 +147,27 @@ void Renderer::computeUnitCircle() {
   }
 }
 
+// white disc with a one texel soft edge. vertex colours tint it, and smooth
+// filtering keeps small particles round when the quad is scaled down
+bool Renderer::buildParticleTexture() {
+  const unsigned size = PARTICLE_TEXTURE_SIZE;
+  const float centre = 0.5f * size;
+  sf::Image image({size, size}, sf::Color::Transparent);
+  for (unsigned py = 0; py < size; py++) {
+    for (unsigned px = 0; px < size; px++) {
+      const float dx = px + 0.5f - centre;
+      const float dy = py + 0.5f - centre;
+      const float edge = centre - std::sqrt(dx * dx + dy * dy);
+      const float a = std::clamp(edge, 0.0f, 1.0f);
+      image.setPixel({px, py}, sf::Color(255, 255, 255,
+                                         static_cast<uint8_t>(255.0f * a)));
+    }
+  }
+  if (!particleTexture_.loadFromImage(image)) return false;
+  particleTexture_.setSmooth(true);
+  return true;
+}
+
 size_t Renderer::getCircleSegments(float radius) {
   const size_t segments = radius * 1.5f + MIN_CIRCLE_SEGMENTS;
   return std::clamp(segments, MIN_CIRCLE_SEGMENTS, MAX_CIRCLE_SEGMENTS);
@@ -102,19 +182,23 @@ const sf::Color Renderer::getRainbow(float t) noexcept {
           static_cast<uint8_t>(255.0f * b * b)};
 }
 
-const sf::Color& Renderer::colorFor(const Particle& p) noexcept {
-  if (!colorLUT_[p.id]) {
+const sf::Color& Renderer::colorFor(uint32_t id) noexcept {
+  // restored snapshots can carry ids from a bigger run
+  if (id >= colorLUT_.size()) colorLUT_.resize(id + 1);
+  if (!colorLUT_[id]) {
     const float t = runtimeClock_.getElapsedTime().asSeconds();
-    colorLUT_[p.id] = getRainbow(t);
+    colorLUT_[id] = getRainbow(t);
   }
-  return *colorLUT_[p.id];
+  return *colorLUT_[id];
 }
 
 void Renderer::layoutUI() noexcept {
   const auto size = window_.getSize();
   lastSize_ = size;
-  sim_.setWorldSize(
-      Vec2f(static_cast<float>(lastSize_.x), static_cast<float>(lastSize_.y)));
+  const Vec2f world(static_cast<float>(lastSize_.x),
+                    static_cast<float>(lastSize_.y));
+  withSim([world](Simulator& sim) { sim.setWorldSize(world); });
+  syncEmitters();
 
   const float margin = 10.0f;
   const auto [sliderWidth, sliderHeight] = gSlider_.getSize();
@@ -131,6 +215,7 @@ void Renderer::layoutUI() noexcept {
 
   // top corner text
   particleCountText_.setPosition({margin, margin});
+  replayText_.setPosition({margin, margin + 40.0f});
   float fpsTextWidth = fpsText_.getLocalBounds().size.x;
   fpsText_.setPosition(
       {static_cast<float>(size.x) - fpsTextWidth - margin, margin});
@@ -152,8 +237,10 @@ void Renderer::handleMousePressed(
       radialPushing_ = true;
       pushOrigin_ = m;
     }
-  } else if (e.button == sf::Mouse::Button::Right) {
-    sim_.spawnParticle({m.x, m.y}, {0.0f, 0.0f}, particleSize_, 1.0f);
+  } else if (e.button == sf::Mouse::Button::Right && !replaying()) {
+    withSim([pos = Vec2f(m.x, m.y), r = particleSize_](Simulator& sim) {
+      sim.spawnParticle(pos, {0.0f, 0.0f}, r, 1.0f);
+    });
   }
 }
 
@@ -181,54 +268,207 @@ void Renderer::handleMouseMoved(const sf::Event::MouseMoved& e) noexcept {
 }
 
 void Renderer::handleKeyPressed(const sf::Event::KeyPressed& e) noexcept {
+  if (replaying() && handleReplayKey(e)) return;
+
   if (e.scancode == sf::Keyboard::Scan::R) {
     randomSpawn_ = !randomSpawn_;
     streamSpawn_ = false;
     randomSpawnSUPERFAST_ = false;
     spawnMax_ = false;
+    syncEmitters();
   } else if (e.scancode == sf::Keyboard::Scan::Space) {
     streamSpawn_ = !streamSpawn_;
     randomSpawn_ = false;
     spawnMax_ = false;
     randomSpawnSUPERFAST_ = false;
+    syncEmitters();
   } else if (e.scancode == sf::Keyboard::Scan::F) {
     randomSpawnSUPERFAST_ = !randomSpawnSUPERFAST_;
     randomSpawn_ = false;
     streamSpawn_ = false;
     spawnMax_ = false;
+    syncEmitters();
   } else if (e.scancode == sf::Keyboard::Scan::M) {
     spawnMax_ = !spawnMax_;
     randomSpawn_ = false;
     randomSpawnSUPERFAST_ = false;
     streamSpawn_ = false;
+    syncEmitters();
+  } else if (e.scancode == sf::Keyboard::Scan::T) {
+    // the simulator stays paused for the whole replay
+    if (!replaying()) setThreadedSimulation(!threadedSimulation());
+  } else if (e.scancode == sf::Keyboard::Scan::S) {
+    saveSnapshot();
+  } else if (e.scancode == sf::Keyboard::Scan::L) {
+    loadSnapshot();
+  } else if (e.scancode == sf::Keyboard::Scan::C) {
+    toggleRecording();
+  } else if (e.scancode == sf::Keyboard::Scan::P) {
+    toggleReplay();
+  } else if (e.scancode == sf::Keyboard::Scan::O) {
+    toggleProfile();
+  } else if (e.scancode == sf::Keyboard::Scan::J) {
+    exportTrace();
+  } else if (e.scancode == sf::Keyboard::Scan::G) {
+    adaptiveGrid_ = !adaptiveGrid_;
+    withSim([on = adaptiveGrid_](Simulator& sim) { sim.setAdaptiveGrid(on); });
+  } else if (e.scancode == sf::Keyboard::Scan::Z) {
+    sleeping_ = !sleeping_;
+    withSim([on = sleeping_](Simulator& sim) { sim.setSleeping(on); });
+  } else if (e.scancode == sf::Keyboard::Scan::Q) {
+    setRenderMode(renderMode_ == ParticleRenderMode::TexturedQuads
+                      ? ParticleRenderMode::TriangleFans
+                      : ParticleRenderMode::TexturedQuads);
+  }
+}
+
+// playback controls, only while replaying. returns false for other keys
+bool Renderer::handleReplayKey(const sf::Event::KeyPressed& e) noexcept {
+  const double second = 1.0 / replay_->dt();
+  switch (e.scancode) {
+    case sf::Keyboard::Scan::K:
+      replayPaused_ = !replayPaused_;
+      break;
+    case sf::Keyboard::Scan::B:
+      replaySpeed_ = -replaySpeed_;
+      break;
+    case sf::Keyboard::Scan::Up:
+      if (std::abs(replaySpeed_) < 16.0f) replaySpeed_ *= 2.0f;
+      break;
+    case sf::Keyboard::Scan::Down:
+      if (std::abs(replaySpeed_) > 1.0f / 16.0f) replaySpeed_ *= 0.5f;
+      break;
+    case sf::Keyboard::Scan::Left:
+      seekReplay(replayFrame_ - second);
+      break;
+    case sf::Keyboard::Scan::Right:
+      seekReplay(replayFrame_ + second);
+      break;
+    case sf::Keyboard::Scan::Comma:
+      replayPaused_ = true;
+      seekReplay(std::floor(replayFrame_) - 1.0);
+      break;
+    case sf::Keyboard::Scan::Period:
+      replayPaused_ = true;
+      seekReplay(std::floor(replayFrame_) + 1.0);
+      break;
+    default:
+      return false;
   }
+  return true;
 }
 
 void Renderer::drawParticles() {
+  RPE_PROFILE_SCOPE("draw");
+  float alpha = 1.0f;
+  const ParticleView particles = particleView(&alpha);
+  const bool quads = renderMode_ == ParticleRenderMode::TexturedQuads;
   const size_t segments = getCircleSegments(particleSize_);
-  size_t vertexCount = segments * 3 * sim_.particles().size();
-
-  // resize if needed
-  if (particleVertices_.getVertexCount() < vertexCount) {
+  const size_t perParticle = quads ? 6 : segments * 3;
+  const size_t vertexCount = perParticle * particles.size();
+  if (vertexCount == 0) return;
+
+  // a different topology invalidates everything written so far
+  if (perParticle != verticesPerParticle_) {
+    verticesPerParticle_ = perParticle;
+    slotIds_.clear();
+  }
+  if (particleVertices_.size() < vertexCount) {
     particleVertices_.resize(vertexCount);
   }
+  {
+    RPE_PROFILE_SCOPE("vertices");
+    refreshSlots(particles);
+    vertexPool_.parallelFor(
+        0, particles.size(), VERTEX_GRAIN, [&](size_t begin, size_t end) {
+          if (quads) {
+            writeQuadPositions(particles, alpha, begin, end);
+          } else {
+            writeFanPositions(particles, alpha, segments, begin, end);
+          }
+        });
+  }
+
+  const sf::RenderStates states(quads ? &particleTexture_ : nullptr);
+  const bool buffered =
+      sf::VertexBuffer::isAvailable() &&
+      (particleBuffer_.getVertexCount() >= vertexCount ||
+       particleBuffer_.create(particleVertices_.size())) &&
+      particleBuffer_.update(particleVertices_.data(), vertexCount, 0);
+  if (buffered) {
+    window_.draw(particleBuffer_, 0, vertexCount, states);
+  } else {
+    window_.draw(particleVertices_.data(), vertexCount,
+                 sf::PrimitiveType::Triangles, states);
+  }
+}
+
+// colour and texture coords only change when a slot gets a different
+// particle (spawns, reorders), so they're written here instead of per frame.
+// colorFor fills its cache lazily, which is why this part stays serial
+void Renderer::refreshSlots(const ParticleView& particles) {
+  const uint32_t none = std::numeric_limits<uint32_t>::max();
+  if (slotIds_.size() < particles.size()) {
+    slotIds_.resize(particles.size(), none);
+  }
+
+  const float t = static_cast<float>(PARTICLE_TEXTURE_SIZE);
+  const sf::Vector2f quadUV[6] = {{0.0f, 0.0f}, {t, 0.0f}, {t, t},
+                                  {0.0f, 0.0f}, {t, t},    {0.0f, t}};
+  const bool quads = renderMode_ == ParticleRenderMode::TexturedQuads;
+  const size_t perParticle = verticesPerParticle_;
+
+  for (size_t p = 0; p < particles.size(); p++) {
+    if (slotIds_[p] == particles.id[p]) continue;
+    slotIds_[p] = particles.id[p];
+
+    const sf::Color& color = colorFor(particles.id[p]);
+    sf::Vertex* v = particleVertices_.data() + p * perParticle;
+    for (size_t k = 0; k < perParticle; k++) {
+      v[k].color = color;
+      v[k].texCoords = quads ? quadUV[k] : sf::Vector2f();
+    }
+  }
+}
 
-  size_t vertexIdx = 0;
-  for (const Particle& par : sim_.particles()) {
-    const Vec2f& pos = par.position;
-    const sf::Color& color = colorFor(par);
+void Renderer::writeQuadPositions(const ParticleView& particles, float alpha,
+                                  size_t begin, size_t end) noexcept {
+  for (size_t p = begin; p < end; p++) {
+    // physics runs at its own rate, draw between its last two steps
+    const float lx = particles.lastX[p];
+    const float ly = particles.lastY[p];
+    const float x = lx + (particles.x[p] - lx) * alpha;
+    const float y = ly + (particles.y[p] - ly) * alpha;
+    const float r = particles.radius[p];
+
+    sf::Vertex* v = particleVertices_.data() + p * 6;
+    v[0].position = {x - r, y - r};
+    v[1].position = {x + r, y - r};
+    v[2].position = {x + r, y + r};
+    v[3].position = {x - r, y - r};
+    v[4].position = {x + r, y + r};
+    v[5].position = {x - r, y + r};
+  }
+}
+
+void Renderer::writeFanPositions(const ParticleView& particles, float alpha,
+                                 size_t segments, size_t begin,
+                                 size_t end) noexcept {
+  const std::vector<sf::Vector2f>& unit = unitCircle_[segments];
+  for (size_t p = begin; p < end; p++) {
+    // physics runs at its own rate, draw between its last two steps
+    const float lx = particles.lastX[p];
+    const float ly = particles.lastY[p];
+    const float x = lx + (particles.x[p] - lx) * alpha;
+    const float y = ly + (particles.y[p] - ly) * alpha;
+    const float r = particles.radius[p];
 
     // transform unit circle vertices
-    const std::vector<sf::Vector2f>& vertices = unitCircle_[segments];
-    for (size_t i = 0; i < vertices.size(); i++) {
-      particleVertices_[vertexIdx] =
-          sf::Vertex{sf::Vector2f(pos.x + par.radius * vertices[i].x,
-                                  pos.y + par.radius * vertices[i].y),
-                     color};
-      vertexIdx++;
+    sf::Vertex* v = particleVertices_.data() + p * unit.size();
+    for (size_t i = 0; i < unit.size(); i++) {
+      v[i].position = {x + r * unit[i].x, y + r * unit[i].y};
     }
   }
-  window_.draw(particleVertices_);
 }
 
 void Renderer::drawComponents() {
@@ -236,6 +476,68 @@ void Renderer::drawComponents() {
   eSlider_.draw(window_);
   window_.draw(fpsText_);
   window_.draw(particleCountText_);
+  if (replaying()) window_.draw(replayText_);
+  if (showProfile_) drawProfile();
+}
+
+// the last frame's profiled scopes as one bar spanning the frame budget,
+// each scope's self time a segment, with a legend of the largest
+void Renderer::drawProfile() {
+  Profiler::frameSummary(profilePhases_);
+
+  const float width = 400.0f;
+  const float height = 16.0f;
+  const float margin = 10.0f;
+  const sf::Vector2f origin(static_cast<float>(lastSize_.x) - width - margin,
+                            margin + 50.0f);
+
+  double total = 0.0;
+  for (const Profiler::PhaseTotal& p : profilePhases_) total += p.seconds;
+  const float scale =
+      width / static_cast<float>(std::max<double>(frameBudget_, total));
+
+  sf::RectangleShape background({width, height});
+  background.setPosition(origin);
+  background.setFillColor(sf::Color(40, 40, 40));
+  background.setOutlineColor(sf::Color::White);
+  background.setOutlineThickness(1.0f);
+  window_.draw(background);
+
+  // scope names are literals, so hashing the text keeps colours stable
+  auto colorOf = [&](const char* name) {
+    const size_t h = std::hash<std::string_view>{}(name);
+    return getRainbow(static_cast<float>(h % 1000) * 0.01f);
+  };
+
+  float x = origin.x;
+  for (const Profiler::PhaseTotal& p : profilePhases_) {
+    const float w = static_cast<float>(p.seconds) * scale;
+    sf::RectangleShape segment({w, height});
+    segment.setPosition({x, origin.y});
+    segment.setFillColor(colorOf(p.name));
+    window_.draw(segment);
+    x += w;
+  }
+
+  const size_t labels = std::min(profilePhases_.size(), MAX_PROFILE_LABELS);
+  while (profileLabels_.size() < labels) {
+    profileLabels_.emplace_back(font_, "", 16);
+  }
+  for (size_t k = 0; k < labels; k++) {
+    const Profiler::PhaseTotal& p = profilePhases_[k];
+    const float y = origin.y + height + 8.0f + 20.0f * k;
+    sf::RectangleShape swatch({12.0f, 12.0f});
+    swatch.setPosition({origin.x, y + 4.0f});
+    swatch.setFillColor(colorOf(p.name));
+    window_.draw(swatch);
+
+    char line[64];
+    std::snprintf(line, sizeof(line), "%-16s %6.2f ms", p.name,
+                  1e3 * p.seconds);
+    profileLabels_[k].setString(line);
+    profileLabels_[k].setPosition({origin.x + 20.0f, y});
+    window_.draw(profileLabels_[k]);
+  }
 }
 
 void Renderer::updateText() noexcept {
@@ -259,63 +561,55 @@ void Renderer::updateText() noexcept {
   }
 
   particleCountText_.setString("Particles: " +
-                               std::to_string(sim_.particles().size()));
-}
-
-void Renderer::randomSpawn() noexcept {
-  if (!randomSpawn_ || sim_.particles().size() >= sim_.capacity()) return;
-
-  if (spawnClock_.getElapsedTime().asSeconds() >= spawnInterval_) {
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    spawnClock_.restart();
-  }
+                               std::to_string(particleCount()) +
+                               (recording() ? "  [rec]" : ""));
 }
 
-void Renderer::randomSpawnSUPERFAST() noexcept {
-  if (!randomSpawnSUPERFAST_ || sim_.particles().size() >= sim_.capacity())
-    return;
-
-  if (spawnClock_.getElapsedTime().asSeconds() >= spawnInterval_) {
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
-    spawnClock_.restart();
-  }
-}
-
-void Renderer::streamSpawn() noexcept {
-  if (!streamSpawn_ || sim_.particles().size() >= sim_.capacity()) return;
-
-  if (spawnClock_.getElapsedTime().asSeconds() >= spawnInterval_) {
-    const float speed = 1200.0f;  // tune these
-    const float omega = 0.5f;     // parameters
-    const float t = runtimeClock_.getElapsedTime().asSeconds();
-    const float angle = 0.5f * PI * (cos(t * omega) + 1.0f);
-    sim_.spawnParticle({lastSize_.x * 0.5f, 25.0f},
-                       Vec2f(cos(angle), sin(angle)) * speed, particleSize_,
-                       1.0f);
-    spawnClock_.restart();
+// R, F and Space each swap in one emitter that runs inside the simulator, so
+// particles keep coming at the same rate however fast frames are drawn
+void Renderer::syncEmitters() {
+  const Vec2f world(static_cast<float>(lastSize_.x),
+                    static_cast<float>(lastSize_.y));
+  Emitter emitter;
+  emitter.radius = particleSize_;
+  // the same +-10 px/s nudge single spawns get
+  emitter.jitter = 10.0f;
+  const bool emitting = randomSpawn_ || randomSpawnSUPERFAST_ || streamSpawn_;
+  if (streamSpawn_) {
+    emitter.shape = Emitter::Shape::Stream;
+    emitter.position = {world.x * 0.5f, 25.0f};
+    emitter.rate = SPAWN_RATE;
+    emitter.speed = 1200.0f;
+    emitter.angle = 0.5f * PI;
+    emitter.sweep = 0.5f * PI;
+    emitter.omega = 0.5f;
+  } else {
+    emitter.shape = Emitter::Shape::Area;
+    emitter.size = {world.x - 20.0f, world.y - 20.0f};
+    emitter.rate = randomSpawnSUPERFAST_ ? 5.0f * SPAWN_RATE : SPAWN_RATE;
   }
+  withSim([emitter, emitting](Simulator& sim) {
+    sim.clearEmitters();
+    if (emitting) sim.addEmitter(emitter);
+  });
 }
 
 void Renderer::spawnMax() noexcept {
-  if (!spawnMax_ || sim_.particles().size() >= sim_.capacity()) return;
+  if (!spawnMax_ || particleCount() >= sim_.capacity()) return;
 
   const float baseTime = runtimeClock_.getElapsedTime().asSeconds();
   for (size_t i = 0; i < sim_.capacity(); i++) {
-    sim_.spawnParticle({distX(gen_), distY(gen_)}, {0.0f, 0.0f}, particleSize_,
-                       1.0f);
     const float t = baseTime + i * 0.001f;
     colorLUT_[i] = getRainbow(t);
   }
+  SpawnPattern pattern;
+  pattern.shape = SpawnPattern::Shape::Random;
+  pattern.size = {lastSize_.x - 20.0f, lastSize_.y - 20.0f};
+  // the same +-10 px/s nudge single spawns get
+  pattern.jitter = 10.0f;
+  withSim([pattern, r = particleSize_](Simulator& sim) {
+    sim.spawnParticles(pattern, sim.capacity(), r, 1.0f);
+  });
   spawnMax_ = false;
 }
 
@@ -324,6 +618,198 @@ void Renderer::radialPush(const int scale) {
 
   const float pDiam = particleSize_ * 2;
 
-  sim_.radialPush({pushOrigin_.x, pushOrigin_.y}, pDiam * scale, 2000.0f,
-                  scale);
+  withSim([origin = Vec2f(pushOrigin_.x, pushOrigin_.y), pDiam,
+           scale](Simulator& sim) {
+    sim.radialPush(origin, pDiam * scale, 2000.0f, scale);
+  });
+}
+
+// the simulation thread is paused for the copy only; the file is written in
+// the background
+void Renderer::saveSnapshot() {
+  const bool threaded = threadedSimulation();
+  setThreadedSimulation(false);
+  try {
+    if (pendingSave_.valid()) pendingSave_.get();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+  }
+  pendingSave_ = Snapshot::saveAsync(sim_, snapshotPath_);
+  setThreadedSimulation(threaded);
+}
+
+void Renderer::loadSnapshot() {
+  const bool threaded = threadedSimulation();
+  setThreadedSimulation(false);
+  try {
+    Snapshot::load(sim_, snapshotPath_);
+    gravity_ = syncedGravity_ = sim_.gravity;
+    restitution_ = syncedRestitution_ = sim_.restitution;
+    // re-seats the slider handles and keeps the window's world size
+    layoutUI();
+    colorLUT_.assign(colorLUT_.size(), std::optional<sf::Color>());
+    slotIds_.clear();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+  }
+  setThreadedSimulation(threaded);
+}
+
+// a file that fails to open leaves recording off
+void Renderer::setRecording(bool enabled) {
+  if (enabled == recording()) return;
+  std::unique_ptr<TrajectoryRecorder> recorder;
+  if (enabled) {
+    recorder = std::make_unique<TrajectoryRecorder>(trajectoryPath_);
+  }
+
+  // swap recorders between steps; the old one finishes its file afterwards
+  const bool threaded = threadedSimulation();
+  setThreadedSimulation(false);
+  sim_.setRecorder(recorder.get());
+  std::swap(recorder_, recorder);
+  setThreadedSimulation(threaded);
+}
+
+void Renderer::toggleRecording() {
+  try {
+    setRecording(!recording());
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+  }
+}
+
+void Renderer::startReplay(const std::string& path) {
+  auto reader = std::make_unique<TrajectoryReader>(path);
+  if (reader->frameCount() == 0) {
+    throw std::runtime_error("Trajectory has no frames: " + path);
+  }
+  if (!replaying()) {
+    replayResumeThreaded_ = threadedSimulation();
+    setThreadedSimulation(false);
+  }
+  replay_ = std::move(reader);
+  replayFromIndex_ = replayToIndex_ = SIZE_MAX;
+  replayFrame_ = 0.0;
+  replaySpeed_ = 1.0f;
+  replayPaused_ = false;
+  loadReplayFrames(0);
+  replayClock_.restart();
+}
+
+void Renderer::stopReplay() {
+  if (!replaying()) return;
+  replay_.reset();
+  replayFrom_ = TrajectoryFrame{};
+  replayTo_ = TrajectoryFrame{};
+  replayLastX_ = {};
+  replayLastY_ = {};
+  setThreadedSimulation(replayResumeThreaded_);
+}
+
+void Renderer::toggleReplay() {
+  if (replaying()) {
+    stopReplay();
+    return;
+  }
+  try {
+    // a file still being written has no index yet
+    setRecording(false);
+    startReplay(trajectoryPath_);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+  }
+}
+
+void Renderer::advanceReplay() {
+  const double elapsed = replayClock_.restart().asSeconds();
+  const double framesPerSecond = 1.0 / replay_->dt();
+  if (!replayPaused_) {
+    seekReplay(replayFrame_ + replaySpeed_ * elapsed * framesPerSecond);
+  }
+
+  // page in about a second ahead of the playhead, whichever way it runs
+  const double ahead = replayFrame_ + std::copysign(framesPerSecond,
+                                                    replaySpeed_);
+  replay_->prefetch(static_cast<size_t>(
+      std::clamp(ahead, 0.0, static_cast<double>(replay_->frameCount() - 1))));
+
+  try {
+    loadReplayFrames(static_cast<size_t>(replayFrame_));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    stopReplay();
+    return;
+  }
+
+  char status[96];
+  std::snprintf(status, sizeof(status), "Replay %zu/%zu  x%g%s",
+                replayFromIndex_ + 1, replay_->frameCount(), replaySpeed_,
+                replayPaused_ ? "  paused" : "");
+  replayText_.setString(status);
+}
+
+void Renderer::seekReplay(double frame) noexcept {
+  const double last = static_cast<double>(replay_->frameCount() - 1);
+  replayFrame_ = std::clamp(frame, 0.0, last);
+}
+
+// neighbouring playheads share a frame, so playing in either direction
+// decodes one new frame per recorded step
+void Renderer::loadReplayFrames(size_t from) {
+  const size_t to = std::min(from + 1, replay_->frameCount() - 1);
+  if (from == replayFromIndex_ && to == replayToIndex_) return;
+
+  if (from == replayToIndex_ || to == replayFromIndex_) {
+    std::swap(replayFrom_, replayTo_);
+    std::swap(replayFromIndex_, replayToIndex_);
+  }
+  if (replayFromIndex_ != from) {
+    replayFromIndex_ = SIZE_MAX;
+    replay_->readFrame(from, replayFrom_);
+    replayFromIndex_ = from;
+  }
+  if (replayToIndex_ != to) {
+    replayToIndex_ = SIZE_MAX;
+    if (to == from) {
+      replayTo_ = replayFrom_;
+    } else {
+      replay_->readFrame(to, replayTo_);
+    }
+    replayToIndex_ = to;
+  }
+
+  // both frames are in id order; particles spawned in between start in place
+  const size_t n = replayTo_.id.size();
+  replayLastX_.resize(n);
+  replayLastY_.resize(n);
+  size_t j = 0;
+  for (size_t k = 0; k < n; k++) {
+    const uint32_t id = replayTo_.id[k];
+    while (j < replayFrom_.id.size() && replayFrom_.id[j] < id) j++;
+    const bool found = j < replayFrom_.id.size() && replayFrom_.id[j] == id;
+    replayLastX_[k] = found ? replayFrom_.x[j] : replayTo_.x[k];
+    replayLastY_[k] = found ? replayFrom_.y[j] : replayTo_.y[k];
+  }
+}
+
+void Renderer::toggleProfile() {
+  if (!Profiler::ENABLED) {
+    std::cerr << "built without RPENGINE_PROFILE, nothing to show\n";
+    return;
+  }
+  showProfile_ = !showProfile_;
+}
+
+void Renderer::exportTrace() {
+  if (!Profiler::ENABLED) {
+    std::cerr << "built without RPENGINE_PROFILE, nothing to export\n";
+    return;
+  }
+  try {
+    Profiler::writeChromeTrace(tracePath_);
+    std::cerr << "wrote " << tracePath_ << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+  }
 }